@@ -0,0 +1,62 @@
+#!/usr/bin/env sh
+
+# Seeds a scratch PostGIS server with a small, fixed OSM extract for bench/replay.ts.
+# Runs in the import image (osm2pgsql, psql) with the style files in /input, e.g.
+#   podman-compose -f podman-compose.yml -f podman-compose.import.yml run --rm \
+#     -e BENCH_PGHOST=bench-db -e BENCH_PGPORT=5432 -v ./mapnik/bench/fixtures:/bench \
+#     --entrypoint sh import /bench/seed.sh [--record]
+# The target server is taken from BENCH_PGHOST only, so the production database is never imported over.
+
+set -e
+
+if [ -z "${BENCH_PGHOST}" ]; then
+  echo "BENCH_PGHOST is not set; refusing to import into the default database server."
+  exit 1
+fi
+
+export PGHOST="${BENCH_PGHOST}"
+export PGPORT="${BENCH_PGPORT:-5432}"
+export DBNAME="${DBNAME:-osm}"
+
+# Covers the polygons of bench/corpus.json. The download URL is refreshed weekly, so the
+# extract a baseline was recorded with is pinned by its checksum in extract.sha256 (next to
+# this script, committed together with bench/baseline.json) and kept in /input.
+BENCH_EXTRACT_URL="${BENCH_EXTRACT_URL:-https://download.bbbike.org/osm/bbbike/Stuttgart/Stuttgart.osm.pbf}"
+BENCH_EXTRACT_FILE="${BENCH_EXTRACT_FILE:-bench.osm.pbf}"
+CHECKSUM_FILE="$(dirname "$0")/extract.sha256"
+
+if [ ! -f "/input/${BENCH_EXTRACT_FILE}" ]; then
+  echo "Downloading ${BENCH_EXTRACT_URL}..."
+  python3 -c 'import sys, urllib.request; urllib.request.urlretrieve(sys.argv[1], sys.argv[2])' \
+    "${BENCH_EXTRACT_URL}" "/input/${BENCH_EXTRACT_FILE}"
+fi
+
+# --record pins the current extract when a new baseline is recorded.
+if [ "$1" = "--record" ]; then
+  sha256sum "/input/${BENCH_EXTRACT_FILE}" | cut -d ' ' -f 1 > "${CHECKSUM_FILE}"
+  echo "Pinned $(cat "${CHECKSUM_FILE}") in ${CHECKSUM_FILE}; commit it with bench/baseline.json."
+fi
+
+if [ -z "${BENCH_EXTRACT_SHA256}" ] && [ -f "${CHECKSUM_FILE}" ]; then
+  BENCH_EXTRACT_SHA256="$(cat "${CHECKSUM_FILE}")"
+fi
+if [ -z "${BENCH_EXTRACT_SHA256}" ]; then
+  echo "No pinned extract: set BENCH_EXTRACT_SHA256 or run with --record to write ${CHECKSUM_FILE}."
+  exit 1
+fi
+if ! echo "${BENCH_EXTRACT_SHA256}  /input/${BENCH_EXTRACT_FILE}" | sha256sum -c -; then
+  echo "/input/${BENCH_EXTRACT_FILE} is not the pinned extract; results would not be comparable with the baseline."
+  exit 1
+fi
+
+echo "Waiting for postgres..."
+
+while ! nc -z "${PGHOST}" "${PGPORT}"; do
+  sleep 0.1
+done
+
+psql -U "${PGUSER}" -d postgres -tc "SELECT 1 FROM pg_database WHERE datname = '${DBNAME}'" | grep -q 1 \
+  || psql -U "${PGUSER}" -d postgres -c "CREATE DATABASE \"${DBNAME}\";"
+psql -U "${PGUSER}" -d "${DBNAME}" -c 'CREATE EXTENSION IF NOT EXISTS postgis;'
+
+OSM2PGSQL_DATAFILE="${BENCH_EXTRACT_FILE}" exec sh /usr/local/bin/entrypoint.sh
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2019-2025 Simon Zigelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+import type {QueueChannel, QueueMessage} from '../src/app/consumer.ts'
+
+export interface ReplayMessage extends QueueMessage {
+    tag: number;
+    publishedAt: number;
+    consumedAt?: number;
+    settledAt?: number;
+    acked?: boolean;
+}
+
+export interface SentMessage {
+    queue: string;
+    content: Buffer;
+    sentAt: number;
+}
+
+/**
+ * In-process stand-in for the RabbitMQ channel used by app.ts: messages are delivered to the
+ * consumer in publish order with at most prefetch of them unacknowledged, like channel.prefetch().
+ * Nacked messages are never requeued.
+ */
+export class MemoryQueue implements QueueChannel<ReplayMessage> {
+    readonly sent: Array<SentMessage> = [];
+    readonly settled: Array<ReplayMessage> = [];
+    private waiting: Array<ReplayMessage> = [];
+    private unacked = 0;
+    private published = 0;
+    private handler: ((msg: ReplayMessage | null) => Promise<void>) | undefined = undefined;
+    private drainedResolvers: Array<() => void> = [];
+
+    constructor(private readonly prefetch: number) {
+    }
+
+    publish(content: Buffer): ReplayMessage {
+        const msg: ReplayMessage = {content: content, tag: ++this.published, publishedAt: performance.now()};
+        this.waiting.push(msg);
+        this.dispatch();
+        return msg;
+    }
+
+    consume(handler: (msg: ReplayMessage | null) => Promise<void>) {
+        this.handler = handler;
+        this.dispatch();
+    }
+
+    ack(message: ReplayMessage) {
+        this.settle(message, true);
+    }
+
+    nack(message: ReplayMessage, _allUpTo?: boolean, _requeue?: boolean) {
+        this.settle(message, false);
+    }
+
+    sendToQueue(queue: string, content: Buffer): boolean {
+        this.sent.push({queue: queue, content: content, sentAt: performance.now()});
+        return true;
+    }
+
+    // Resolves once every published message has been acked or nacked.
+    drained(): Promise<void> {
+        if (this.settled.length === this.published)
+            return Promise.resolve();
+        return new Promise(resolve => this.drainedResolvers.push(resolve));
+    }
+
+    private settle(message: ReplayMessage, acked: boolean) {
+        if (message.settledAt !== undefined)
+            throw new Error(`Message ${message.tag} settled twice`);
+        message.settledAt = performance.now();
+        message.acked = acked;
+        this.settled.push(message);
+        this.unacked--;
+        this.dispatch();
+        if (this.settled.length === this.published) {
+            for (const resolve of this.drainedResolvers.splice(0))
+                resolve();
+        }
+    }
+
+    private dispatch() {
+        while (this.handler !== undefined && this.unacked < this.prefetch && this.waiting.length > 0) {
+            const msg = this.waiting.shift()!;
+            msg.consumedAt = performance.now();
+            this.unacked++;
+            void this.handler(msg);
+        }
+    }
+}
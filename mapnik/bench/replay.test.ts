@@ -0,0 +1,79 @@
+/*
+ * Copyright 2019-2025 Simon Zigelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+import {compareToBaseline, percentile, type Report, summarize} from "./stats.ts";
+import {MemoryQueue, type ReplayMessage} from "./queue.ts";
+import {describe, expect, test} from "bun:test";
+
+function report(jobsPerSecond: number, totalP50: number, bytes: number, workerMb: number = 50): Report {
+    return {
+        date: '', host: {platform: '', cpus: 1, parallelism: 1}, jobs: 10, failed: 0, durationSeconds: 1,
+        jobsPerSecond: jobsPerSecond,
+        stages: {total: {count: 10, p50: totalP50, p90: totalP50 * 2, p99: totalP50 * 3, max: totalP50 * 4}},
+        peakRssMb: 100,
+        workerPeakMb: {'1': workerMb / 2, '2': workerMb},
+        output: {files: 10, totalBytes: bytes, p50: bytes / 10, max: bytes / 10, byMediaType: {}}
+    };
+}
+
+describe('testing percentile', () => {
+    test('nearest rank of unsorted values', () => {
+        expect(percentile([5, 1, 4, 2, 3], 50)).toBe(3);
+        expect(percentile([5, 1, 4, 2, 3], 90)).toBe(5);
+        expect(percentile([], 50)).toBe(0);
+        expect(summarize([1, 2, 3, 4]).max).toBe(4);
+    });
+});
+
+describe('testing compareToBaseline', () => {
+    test('changes within the tolerance pass', () => {
+        const comparisons = compareToBaseline(report(10.5, 95, 1000), report(10, 100, 1000), 0.1);
+        expect(comparisons.some(c => c.regression)).toBe(false);
+    });
+
+    test('slower runs, higher latencies and changed output sizes regress', () => {
+        const regressions = compareToBaseline(report(8, 130, 500), report(10, 100, 1000), 0.1)
+            .filter(c => c.regression).map(c => c.metric);
+        expect(regressions).toStrictEqual(['jobsPerSecond', 'total.p50', 'total.p90', 'output.totalBytes']);
+    });
+
+    test('the largest worker peak is compared', () => {
+        const regressions = compareToBaseline(report(10, 100, 1000, 80), report(10, 100, 1000), 0.1)
+            .filter(c => c.regression).map(c => c.metric);
+        expect(regressions).toStrictEqual(['workerPeakMb.max']);
+    });
+});
+
+describe('testing MemoryQueue', () => {
+    test('prefetch limits unacknowledged messages', async () => {
+        const queue = new MemoryQueue(2);
+        let inFlight: ReplayMessage[] = [];
+        queue.consume(async msg => {
+            inFlight.push(msg!);
+        });
+        for (let i = 0; i < 3; i++)
+            queue.publish(Buffer.from(`${i}`));
+        expect(inFlight.length).toBe(2);
+
+        queue.ack(inFlight[0]!);
+        expect(inFlight.length).toBe(3);
+        queue.nack(inFlight[1]!, false, false);
+        queue.ack(inFlight[2]!);
+        await queue.drained();
+        expect(queue.settled.map(msg => msg.acked)).toStrictEqual([true, false, true]);
+        expect(() => queue.ack(inFlight[0]!)).toThrow();
+    });
+});
@@ -0,0 +1,230 @@
+/*
+ * Copyright 2019-2025 Simon Zigelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Replays a corpus of captured jobs through the same path as app.ts (consumer, scheduler, worker pool,
+ * renderer, file writes) with an in-process queue instead of RabbitMQ. PostGIS is whatever PGHOST/PGPORT
+ * point at, normally a database seeded with fixtures/seed.sh.
+ *
+ *   bun bench/replay.ts [--corpus file] [--baseline file] [--update-baseline] [--repeat n] [--out file]
+ */
+
+import {availableParallelism, FixedThreadPool} from 'poolifier-web-worker'
+import type {Inputs} from '../src/app/rendererWorker.ts'
+import type {Territorium} from '../src/app/index.d.ts'
+import {createConsumer, memoryEstimateFromEnv, numberFromEnv, schedulerFromEnv} from '../src/app/consumer.ts'
+import {MemoryQueue, type ReplayMessage} from './queue.ts'
+import {compareToBaseline, percentile, type Report, summarize} from './stats.ts'
+
+import * as fs from 'node:fs';
+import * as os from 'node:os';
+import path from 'node:path';
+import {parseArgs} from 'node:util';
+
+interface CorpusEntry {
+    name: string;
+    repeat: number | undefined;
+    job: Territorium.Job;
+}
+
+interface Corpus {
+    description: string | undefined;
+    entries: Array<CorpusEntry>;
+}
+
+const {values: args} = parseArgs({
+    options: {
+        'corpus': {type: 'string', default: path.join(import.meta.dir, 'corpus.json')},
+        'baseline': {type: 'string', default: path.join(import.meta.dir, 'baseline.json')},
+        'update-baseline': {type: 'boolean', default: false},
+        'repeat': {type: 'string', default: '1'},
+        'out': {type: 'string'},
+        'keep-output': {type: 'boolean', default: false},
+        'verbose': {type: 'boolean', default: false},
+    },
+});
+
+const parallelism = availableParallelism();
+const prefetch = numberFromEnv('QUEUE_PREFETCH', parallelism * 4);
+const interactivePixels = numberFromEnv('INTERACTIVE_MAX_PIXELS', 4 * 1024 * 1024);
+const tolerance = numberFromEnv('BENCH_TOLERANCE', 0.1);
+const warmup = numberFromEnv('BENCH_WARMUP', parallelism);
+const repeat = Math.max(1, Number(args.repeat) || 1);
+
+const log = console.log;
+if (!args.verbose)
+    console.log = () => undefined;
+
+const corpus = JSON.parse(fs.readFileSync(args.corpus!, 'utf-8')) as Corpus;
+// Round robin over the entries so every kind of job is spread over the whole run.
+let jobs: Array<{ name: string; data: string }> = [];
+const rounds = Math.max(...corpus.entries.map(e => e.repeat ?? 1)) * repeat;
+for (let round = 0; round < rounds; round++) {
+    for (const entry of corpus.entries) {
+        if (round < (entry.repeat ?? 1) * repeat)
+            jobs.push({name: entry.name, data: JSON.stringify({...entry.job, job: `${entry.name}#${round}`})});
+    }
+}
+if (jobs.length === 0)
+    throw new Error(`No jobs in ${args.corpus}`);
+
+const directory = fs.mkdtempSync(path.join(os.tmpdir(), 'tms-bench-'));
+const queue = new MemoryQueue(prefetch);
+const started = new Map<Buffer, number>();
+
+// Workers report their own memory peaks; only those of the measured run are kept.
+process.env.REPORT_WORKER_MEMORY = '1';
+let measuring = false;
+let workerPeaks: Record<string, number> = {};
+
+const pool = new FixedThreadPool<Inputs, Territorium.JobResult | undefined>(
+    parallelism,
+    new URL('../src/app/rendererWorker.ts', import.meta.url),
+    {
+        errorEventHandler: (e: ErrorEvent) => {
+            console.error(e);
+        },
+        messageEventHandler: (message: any) => {
+            const data = message?.data ?? message;
+            if (data?.type === 'memory') {
+                if (measuring)
+                    workerPeaks[String(data.worker)] = Math.max(workerPeaks[String(data.worker)] ?? 0, data.peakBytes);
+            } else if (data?.error === true)
+                console.error('Worker:', data.message);
+            else if (args.verbose)
+                log('Worker:', data);
+        }
+    },
+);
+
+queue.consume(createConsumer(queue, {
+    sendQueue: 'maps',
+    directory: directory,
+    scheduler: schedulerFromEnv(parallelism),
+    execute: (inputs) => pool.execute(inputs),
+    memoryEstimate: await memoryEstimateFromEnv(),
+    interactivePixels: interactivePixels,
+    onStart: (content) => started.set(content, performance.now()),
+}));
+
+// Warm up fonts, styles, caches and connections of every worker before measuring.
+for (let i = 0; i < warmup; i++)
+    queue.publish(Buffer.from(jobs[i % jobs.length]!.data));
+await queue.drained();
+const measuredFrom = queue.settled.length;
+const sentFrom = queue.sent.length;
+
+measuring = true;
+
+let peakRss = process.memoryUsage.rss();
+const sampler = setInterval(() => peakRss = Math.max(peakRss, process.memoryUsage.rss()), 50);
+
+log(`Replaying ${jobs.length} jobs from ${args.corpus} with ${parallelism} workers (prefetch ${prefetch})`);
+const begin = performance.now();
+let messages: Array<ReplayMessage> = [];
+for (const job of jobs)
+    messages.push(queue.publish(Buffer.from(job.data)));
+await queue.drained();
+const durationSeconds = (performance.now() - begin) / 1000;
+clearInterval(sampler);
+// Not process.resourceUsage().maxRSS: that would include the warm-up.
+peakRss = Math.max(peakRss, process.memoryUsage.rss());
+measuring = false;
+
+let stages: Record<string, number[]> = {queue: [], schedule: [], worker: [], render: [], total: []};
+for (const msg of messages) {
+    const startedAt = started.get(msg.content) ?? msg.consumedAt!;
+    stages.queue!.push(msg.consumedAt! - msg.publishedAt);
+    stages.schedule!.push(startedAt - msg.consumedAt!);
+    stages.worker!.push(msg.settledAt! - startedAt);
+    stages.total!.push(msg.settledAt! - msg.publishedAt);
+}
+
+let sizes: number[] = [];
+let byMediaType: Record<string, number> = {};
+let failed = queue.settled.slice(measuredFrom).filter(msg => !msg.acked).length;
+for (const sent of queue.sent.slice(sentFrom)) {
+    const jobResult = JSON.parse(sent.content.toString()) as Territorium.JobResult;
+    if (jobResult.error)
+        failed++;
+    const results = jobResult.result instanceof Array ? jobResult.result : [jobResult.result];
+    for (const result of results) {
+        if (result.renderMs !== undefined && result.renderMs !== null)
+            stages.render!.push(result.renderMs);
+        if (result.error)
+            continue;
+        const size = fs.statSync(path.join(directory, result.payload as string)).size;
+        sizes.push(size);
+        const mediaType = result.mediaType ?? 'unknown';
+        byMediaType[mediaType] = (byMediaType[mediaType] ?? 0) + size;
+    }
+}
+
+const report: Report = {
+    date: new Date().toISOString(),
+    host: {platform: `${os.platform()} ${os.arch()}`, cpus: os.cpus().length, parallelism: parallelism},
+    jobs: messages.length,
+    failed: failed,
+    durationSeconds: durationSeconds,
+    jobsPerSecond: messages.length / durationSeconds,
+    stages: Object.fromEntries(Object.entries(stages).map(([stage, values]) => [stage, summarize(values)])),
+    peakRssMb: peakRss / 1024 / 1024,
+    workerPeakMb: Object.fromEntries(Object.entries(workerPeaks).map(([worker, bytes]) => [worker, bytes / 1024 / 1024])),
+    output: {
+        files: sizes.length,
+        totalBytes: sizes.reduce((a, b) => a + b, 0),
+        p50: percentile(sizes, 50),
+        max: percentile(sizes, 100),
+        byMediaType: byMediaType
+    },
+};
+
+await pool.destroy();
+if (!args['keep-output'])
+    fs.rmSync(directory, {recursive: true, force: true});
+else
+    log(`Output kept in ${directory}`);
+
+log(`${report.jobs} jobs in ${report.durationSeconds.toFixed(1)} s: ${report.jobsPerSecond.toFixed(2)} jobs/s, ${report.failed} failed`);
+log('stage       p50 ms    p90 ms    p99 ms    max ms');
+for (const [stage, p] of Object.entries(report.stages))
+    log(`${stage.padEnd(8)}${[p.p50, p.p90, p.p99, p.max].map(v => v.toFixed(1).padStart(10)).join('')}`);
+log(`peak RSS ${report.peakRssMb.toFixed(0)} MB (whole process incl. native memory, all workers, warm-up excluded)`);
+log(`worker peaks ${Object.values(report.workerPeakMb).map(mb => mb.toFixed(0)).join(', ')} MB (JS heap and external buffers per worker; native Mapnik memory only shows in the RSS)`);
+log(`output ${report.output.files} files, ${(report.output.totalBytes / 1024 / 1024).toFixed(2)} MB`);
+for (const [mediaType, bytes] of Object.entries(report.output.byMediaType))
+    log(`  ${mediaType}: ${(bytes / 1024 / 1024).toFixed(2)} MB`);
+
+if (args.out !== undefined)
+    fs.writeFileSync(args.out, JSON.stringify(report, null, 2) + '\n');
+
+if (report.failed > 0)
+    process.exitCode = 1;
+
+if (args['update-baseline']) {
+    fs.writeFileSync(args.baseline!, JSON.stringify(report, null, 2) + '\n');
+    log(`Baseline written to ${args.baseline}`);
+} else if (fs.existsSync(args.baseline!)) {
+    const baseline = JSON.parse(fs.readFileSync(args.baseline!, 'utf-8')) as Report;
+    log(`Compared to baseline of ${baseline.date} (tolerance ${(tolerance * 100).toFixed(0)} %):`);
+    for (const c of compareToBaseline(report, baseline, tolerance)) {
+        log(`${c.regression ? 'REGRESSION' : 'ok        '} ${c.metric.padEnd(18)} ${c.baseline.toFixed(2).padStart(14)} -> ${c.current.toFixed(2).padStart(14)} (${(c.change * 100).toFixed(1)} %)`);
+        if (c.regression)
+            process.exitCode = 1;
+    }
+} else {
+    log(`No baseline at ${args.baseline}; record one with --update-baseline.`);
+}
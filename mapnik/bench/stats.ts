@@ -0,0 +1,105 @@
+/*
+ * Copyright 2019-2025 Simon Zigelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+export interface Percentiles {
+    count: number;
+    p50: number;
+    p90: number;
+    p99: number;
+    max: number;
+}
+
+export interface OutputSizes {
+    files: number;
+    totalBytes: number;
+    p50: number;
+    max: number;
+    byMediaType: Record<string, number>;
+}
+
+export interface Report {
+    date: string;
+    host: { platform: string; cpus: number; parallelism: number };
+    jobs: number;
+    failed: number;
+    durationSeconds: number;
+    jobsPerSecond: number;
+    // Milliseconds; queue: published until consumed, schedule: consumed until handed to the pool,
+    // worker: pool execution incl. file writes, render: renderer per polygon, total: published until acked.
+    stages: Record<string, Percentiles>;
+    // Peak of the whole process during the measured run (warm-up excluded). Worker threads share
+    // the process, so this is all workers together, including native Mapnik memory.
+    peakRssMb: number;
+    // Peak JS heap plus external buffers per worker thread (by thread id), sampled in the workers
+    // during the measured run. Native allocations cannot be attributed to a thread.
+    workerPeakMb: Record<string, number>;
+    output: OutputSizes;
+}
+
+export interface Comparison {
+    metric: string;
+    baseline: number;
+    current: number;
+    change: number;
+    regression: boolean;
+}
+
+// Nearest rank percentile of unsorted values; 0 for no values.
+export function percentile(values: number[], p: number): number {
+    if (values.length === 0)
+        return 0;
+    const sorted = [...values].sort((a, b) => a - b);
+    const rank = Math.min(sorted.length, Math.max(1, Math.ceil(p / 100 * sorted.length)));
+    return sorted[rank - 1]!;
+}
+
+export function summarize(values: number[]): Percentiles {
+    return {
+        count: values.length,
+        p50: percentile(values, 50),
+        p90: percentile(values, 90),
+        p99: percentile(values, 99),
+        max: percentile(values, 100),
+    };
+}
+
+/**
+ * Compares a run against the baseline. Throughput may not drop and latencies and memory may not
+ * grow by more than tolerance (fraction); output sizes may not change by more than it either way.
+ */
+export function compareToBaseline(current: Report, baseline: Report, tolerance: number): Comparison[] {
+    let comparisons: Comparison[] = [];
+    const add = (metric: string, base: number | undefined, value: number, higherIsWorse: boolean, bothWays: boolean = false) => {
+        if (base === undefined || base === null || base === 0)
+            return;
+        const change = (value - base) / base;
+        let regression = higherIsWorse ? change > tolerance : change < -tolerance;
+        if (bothWays)
+            regression = Math.abs(change) > tolerance;
+        comparisons.push({metric: metric, baseline: base, current: value, change: change, regression: regression});
+    };
+
+    add('jobsPerSecond', baseline.jobsPerSecond, current.jobsPerSecond, false);
+    for (const [stage, values] of Object.entries(current.stages)) {
+        add(`${stage}.p50`, baseline.stages[stage]?.p50, values.p50, true);
+        add(`${stage}.p90`, baseline.stages[stage]?.p90, values.p90, true);
+    }
+    add('peakRssMb', baseline.peakRssMb, current.peakRssMb, true);
+    const workerPeak = (r: Report) => Math.max(0, ...Object.values(r.workerPeakMb ?? {}));
+    add('workerPeakMb.max', workerPeak(baseline), workerPeak(current), true);
+    add('output.totalBytes', baseline.output?.totalBytes, current.output.totalBytes, true, true);
+    return comparisons;
+}
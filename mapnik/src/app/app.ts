@@ -21,6 +21,12 @@ import {
 } from 'poolifier-web-worker'
 import type { Inputs } from './rendererWorker.ts'
 import type { Territorium } from './index.d.ts'
+import {
+    createConsumer,
+    memoryEstimateFromEnv,
+    numberFromEnv,
+    schedulerFromEnv
+} from './consumer.ts'
 
 import path from 'node:path';
 import * as fs from 'node:fs';
@@ -44,13 +50,20 @@ if (!fs.existsSync(dir)) {
     }
 }
 
+const parallelism = availableParallelism();
+const prefetch = numberFromEnv('QUEUE_PREFETCH', parallelism * 4);
+const interactivePixels = numberFromEnv('INTERACTIVE_MAX_PIXELS', 4 * 1024 * 1024);
+
+const memoryEstimate = await memoryEstimateFromEnv();
+const scheduler = schedulerFromEnv(parallelism);
+
 let recQueue = 'mapnik';
 let sendQueue = 'maps';
 
 const workerFileURL = new URL('./rendererWorker.ts', import.meta.url)
 
 const fixedPool = new FixedThreadPool<Inputs, Territorium.JobResult | undefined>(
-    availableParallelism(),
+    parallelism,
     workerFileURL,
     {
         errorEventHandler: (e: ErrorEvent) => {
@@ -70,27 +83,15 @@ const fixedPool = new FixedThreadPool<Inputs, Territorium.JobResult | undefined>
     let channel = await connection.createChannel();
     await channel.assertQueue(recQueue, {durable: true});
     await channel.assertQueue(sendQueue, {durable: true});
-    await channel.prefetch(availableParallelism());
+    await channel.prefetch(prefetch);
     console.log('Waiting for messages from queue %s.', recQueue);
 
-    await channel.consume(recQueue, async function (msg) {
-        if (msg === null) {
-            return;
-        }
-        console.log('Rendering started.');
-        try {
-            const result = await fixedPool.execute({data: msg.content.toString(), directory: dir});
-            console.log('Result:', result);
-            if (result === undefined)
-                channel.nack(msg, false, false);
-            else {
-                if (!channel.sendToQueue(sendQueue, Buffer.from(JSON.stringify(result))))
-                    console.error('Error sending message to queue.');
-                channel.ack(msg)
-            }
-        } catch (e) {
-            console.error('A general Error occured:', e);
-            channel.nack(msg, false, false);
-        }
-    });
+    await channel.consume(recQueue, createConsumer(channel, {
+        sendQueue: sendQueue,
+        directory: dir,
+        scheduler: scheduler,
+        execute: (inputs) => fixedPool.execute(inputs),
+        memoryEstimate: memoryEstimate,
+        interactivePixels: interactivePixels,
+    }));
 })();
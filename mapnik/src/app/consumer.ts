@@ -0,0 +1,102 @@
+/*
+ * Copyright 2019-2025 Simon Zigelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+import type {Inputs} from './rendererWorker.ts'
+import type {Territorium} from './index.d.ts'
+import {defaultMemoryEstimate, estimateJobCost, type JobCost, JobScheduler, type MemoryEstimator} from './scheduler.ts'
+
+import * as os from 'node:os';
+
+// The parts of an AMQP channel the consumer needs; amqplib's channel and the replay harness queue provide them.
+export interface QueueMessage {
+    content: Buffer;
+}
+
+export interface QueueChannel<M extends QueueMessage> {
+    ack(message: M): void;
+
+    nack(message: M, allUpTo?: boolean, requeue?: boolean): void;
+
+    sendToQueue(queue: string, content: Buffer): boolean;
+}
+
+export interface ConsumerOptions {
+    sendQueue: string;
+    directory: string;
+    scheduler: JobScheduler<Territorium.JobResult | undefined>;
+    execute: (inputs: Inputs) => Promise<Territorium.JobResult | undefined>;
+    memoryEstimate: MemoryEstimator;
+    interactivePixels: number;
+    // Called when the scheduler hands the job to the worker pool.
+    onStart?: (content: Buffer, cost: JobCost) => void;
+}
+
+export function numberFromEnv(name: string, fallback: number): number {
+    const value = Number(process.env[name] ?? '');
+    if (process.env[name] === undefined || process.env[name] === '' || isNaN(value))
+        return fallback;
+    return value;
+}
+
+export async function memoryEstimateFromEnv(): Promise<MemoryEstimator> {
+    if (process.env.MOCK !== undefined && process.env.MOCK !== '')
+        return defaultMemoryEstimate;
+    try {
+        const {Mapnik} = await import('./renderer/mapnik.ts');
+        const mapnik = new Mapnik();
+        return (width, height, vector) => mapnik.renderMemoryEstimate(width, height, vector);
+    } catch (e) {
+        console.error('Native memory estimate not available, using fallback:', e);
+        return defaultMemoryEstimate;
+    }
+}
+
+export function schedulerFromEnv(parallelism: number): JobScheduler<Territorium.JobResult | undefined> {
+    return new JobScheduler<Territorium.JobResult | undefined>({
+        maxConcurrent: parallelism,
+        maxPixels: numberFromEnv('RENDER_MAX_PIXELS', 256 * 1024 * 1024),
+        maxMemory: numberFromEnv('RENDER_MAX_MEMORY_MB', Math.floor(os.totalmem() / 1024 / 1024 / 2)) * 1024 * 1024,
+    });
+}
+
+export function createConsumer<M extends QueueMessage>(channel: QueueChannel<M>, options: ConsumerOptions) {
+    return async function (msg: M | null) {
+        if (msg === null) {
+            return;
+        }
+        const data = msg.content.toString();
+        const cost = estimateJobCost(data, options.memoryEstimate, options.interactivePixels);
+        console.log('Job queued:', cost);
+        try {
+            const result = await options.scheduler.schedule(cost, () => {
+                console.log('Rendering started.');
+                options.onStart?.(msg.content, cost);
+                return options.execute({data: data, directory: options.directory});
+            });
+            console.log('Result:', result);
+            if (result === undefined)
+                channel.nack(msg, false, false);
+            else {
+                if (!channel.sendToQueue(options.sendQueue, Buffer.from(JSON.stringify(result))))
+                    console.error('Error sending message to queue.');
+                channel.ack(msg)
+            }
+        } catch (e) {
+            console.error('A general Error occured:', e);
+            channel.nack(msg, false, false);
+        }
+    };
+}
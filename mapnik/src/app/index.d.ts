@@ -58,6 +58,11 @@ export declare namespace Territorium {
         ppi: number;
     }
 
+    interface Derivative {
+        scale: number | undefined; // e.g. 0.5 or 0.25 of the rendered size
+        width: number | undefined; // fixed width in pixels, height keeps the aspect ratio
+    }
+
     interface SubPolygon {
         name: SubPolygonName;
         projection: string | undefined;
@@ -72,10 +77,13 @@ export declare namespace Territorium {
         bbox: [number, number, number, number];
         projection: string | undefined;
         way: any;
-        mediaType: 'image/png' | 'image/svg+xml' | 'application/pdf';
+        mediaType: 'image/png' | 'image/svg+xml' | 'application/pdf' | 'application/vnd.mapbox-vector-tile';
         style: Style | undefined;
         subpolygon: SubPolygon | Array<SubPolygon> | undefined;
         generateWorldFile: boolean;
+        derivatives: Array<Derivative> | undefined; // Only with mediaType = image/png
+        tile: [number, number, number] | undefined; // z/x/y, only with mediaType = application/vnd.mapbox-vector-tile
+        profile: 'full' | 'preview' | undefined; // preview renders a reduced style, default full
     }
 
     interface PolygonContainer {
@@ -107,6 +115,8 @@ export declare namespace Territorium {
         filename: string | undefined;
         mediaType: string | undefined;
         error: boolean;
+        profile: 'full' | 'preview' | undefined;
+        renderMs: number | undefined;
     }
 
     interface ResultBuffer {
@@ -118,6 +128,8 @@ export declare namespace Territorium {
         size: [number, number] | undefined;
         mediaType: string;
         ppi: number | undefined;
+        profile?: 'full' | 'preview';
+        renderMs?: number;
     }
 
     interface Container {
@@ -127,6 +139,27 @@ export declare namespace Territorium {
     }
 }
 
+interface RenderedDerivative {
+    map: Buffer;
+    worldFile: Buffer;
+    size: [number, number];
+}
+
+interface RenderResult {
+    map: string | Buffer<ArrayBufferLike>;
+    // undefined for outputs without a world file (vector tiles).
+    worldFile: Buffer | undefined;
+    derivatives?: Array<RenderedDerivative>;
+    // Set when the render time is not the time of the call that returned it (shared atlas renders).
+    renderMs?: number;
+}
+
 interface AbstractRenderer {
-    map(polygon: Territorium.Polygon): Promise<{ map: string | Buffer<ArrayBufferLike>, worldFile: Buffer }>;
+    map(polygon: Territorium.Polygon): Promise<RenderResult>;
+
+    // Optional native composition of all polygons into one PDF; undefined means "not available".
+    pdf?(page: Territorium.Page, polygons: Array<Territorium.Polygon>): Promise<Buffer | undefined>;
+
+    // Optional shared base map rendering; one entry per polygon, undefined entries are rendered with map().
+    atlas?(polygons: Array<Territorium.Polygon>): Promise<Array<RenderResult | undefined>>;
 }
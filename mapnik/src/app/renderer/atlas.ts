@@ -0,0 +1,134 @@
+/*
+ * Copyright 2019-2025 Simon Zigelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+export type Extent = [number, number, number, number];
+
+export interface AtlasEntry {
+    // Extent of the polygon's map after zoomToBox, i.e. with the aspect ratio of its size.
+    extent: Extent;
+    size: [number, number];
+}
+
+export interface AtlasMember {
+    index: number;
+    x: number;
+    y: number;
+}
+
+export interface AtlasGroup {
+    extent: Extent;
+    size: [number, number];
+    members: Array<AtlasMember>;
+}
+
+function scaleOf(entry: AtlasEntry): number {
+    return (entry.extent[2] - entry.extent[0]) / entry.size[0];
+}
+
+function sameScale(a: AtlasEntry, b: AtlasEntry): boolean {
+    // Less than half a pixel of drift across the larger of both maps.
+    const tolerance = 0.5 / Math.max(a.size[0], a.size[1], b.size[0], b.size[1]);
+    return Math.abs(scaleOf(a) - scaleOf(b)) <= tolerance * scaleOf(a);
+}
+
+function touches(a: Extent, b: Extent): boolean {
+    return a[0] <= b[2] && b[0] <= a[2] && a[1] <= b[3] && b[1] <= a[3];
+}
+
+// Splits maps of one scale into clusters of overlapping or touching extents (transitively).
+function clusters(entries: Array<AtlasEntry>, indices: Array<number>): Array<Array<number>> {
+    const parent = indices.map((_, i) => i);
+    const root = (i: number): number => {
+        while (parent[i] !== i)
+            i = parent[i] = parent[parent[i]!]!;
+        return i;
+    };
+    for (let i = 0; i < indices.length; i++) {
+        for (let j = i + 1; j < indices.length; j++) {
+            if (touches(entries[indices[i]!]!.extent, entries[indices[j]!]!.extent))
+                parent[root(j)] = root(i);
+        }
+    }
+
+    const byRoot: Record<number, Array<number>> = {};
+    indices.forEach((index, i) => (byRoot[root(i)] ??= []).push(index));
+    return Object.values(byRoot);
+}
+
+function layout(entries: Array<AtlasEntry>, indices: Array<number>): AtlasGroup {
+    const first = entries[indices[0]!]!;
+    const scale = scaleOf(first);
+    let minx = Infinity, maxy = -Infinity, maxx = -Infinity, miny = Infinity;
+    for (const index of indices) {
+        const extent = entries[index]!.extent;
+        minx = Math.min(minx, extent[0]);
+        miny = Math.min(miny, extent[1]);
+        maxx = Math.max(maxx, extent[2]);
+        maxy = Math.max(maxy, extent[3]);
+    }
+
+    let width = Math.ceil((maxx - minx) / scale);
+    let height = Math.ceil((maxy - miny) / scale);
+    const members: Array<AtlasMember> = [];
+    for (const index of indices) {
+        const entry = entries[index]!;
+        const x = Math.round((entry.extent[0] - minx) / scale);
+        const y = Math.round((maxy - entry.extent[3]) / scale);
+        width = Math.max(width, x + entry.size[0]);
+        height = Math.max(height, y + entry.size[1]);
+        members.push({index: index, x: x, y: y});
+    }
+    return {
+        extent: [minx, maxy - height * scale, minx + width * scale, maxy],
+        size: [width, height],
+        members: members
+    };
+}
+
+/**
+ * Groups maps sharing a scale and overlapping or touching each other, so their base map can be
+ * rendered once for the union extent. Each cluster is evaluated on its own: a group is only
+ * returned if the shared canvas is smaller than rendering its members one by one and stays
+ * below maxPixels; maps not in any group are rendered on their own.
+ */
+export function planAtlas(entries: Array<AtlasEntry>, maxPixels: number): Array<AtlasGroup> {
+    const order = entries
+        .map((_, index) => index)
+        .filter(index => entries[index]!.size[0] > 0 && entries[index]!.size[1] > 0)
+        .sort((a, b) => scaleOf(entries[a]!) - scaleOf(entries[b]!));
+
+    const scales: Array<Array<number>> = [];
+    for (const index of order) {
+        const current = scales[scales.length - 1];
+        if (current !== undefined && sameScale(entries[current[0]!]!, entries[index]!))
+            current.push(index);
+        else
+            scales.push([index]);
+    }
+    const candidates = scales.flatMap(indices => clusters(entries, indices));
+
+    const groups: Array<AtlasGroup> = [];
+    for (const indices of candidates) {
+        if (indices.length < 2)
+            continue;
+        const group = layout(entries, indices);
+        const pixels = group.size[0] * group.size[1];
+        const separate = indices.reduce((sum, index) => sum + entries[index]!.size[0] * entries[index]!.size[1], 0);
+        if (pixels <= maxPixels && pixels < separate)
+            groups.push(group);
+    }
+    return groups;
+}
@@ -22,6 +22,101 @@ if (url === undefined || url === '')
 
 let VERSION = "0.1.0-alpha01"
 
+const MM = 72.0 / 25.4;
+const INCH = 72.0;
+
+// Portrait page sizes in points
+const PAGE_SIZES: Record<string, [number, number]> = {
+    A0: [841 * MM, 1189 * MM], A1: [594 * MM, 841 * MM], A2: [420 * MM, 594 * MM], A3: [297 * MM, 420 * MM],
+    A4: [210 * MM, 297 * MM], A5: [148 * MM, 210 * MM], A6: [105 * MM, 148 * MM], A7: [74 * MM, 105 * MM],
+    A8: [52 * MM, 74 * MM], A9: [37 * MM, 52 * MM], A10: [26 * MM, 37 * MM],
+    B0: [1000 * MM, 1414 * MM], B1: [707 * MM, 1000 * MM], B2: [500 * MM, 707 * MM], B3: [353 * MM, 500 * MM],
+    B4: [250 * MM, 353 * MM], B5: [176 * MM, 250 * MM], B6: [125 * MM, 176 * MM], B7: [88 * MM, 125 * MM],
+    B8: [62 * MM, 88 * MM], B9: [44 * MM, 62 * MM], B10: [31 * MM, 44 * MM],
+    LETTER: [8.5 * INCH, 11 * INCH], LEGAL: [8.5 * INCH, 14 * INCH], TABLOID: [11 * INCH, 17 * INCH],
+    LEDGER: [17 * INCH, 11 * INCH], JUNIOR_LEGAL: [5 * INCH, 8 * INCH], HALF_LETTER: [5.5 * INCH, 8.5 * INCH],
+    GOV_LETTER: [8 * INCH, 10.5 * INCH], GOV_LEGAL: [8.5 * INCH, 13 * INCH],
+    ANSI_A: [8.5 * INCH, 11 * INCH], ANSI_B: [11 * INCH, 17 * INCH], ANSI_C: [17 * INCH, 22 * INCH],
+    ANSI_D: [22 * INCH, 34 * INCH], ANSI_E: [34 * INCH, 44 * INCH],
+    ARCH_A: [9 * INCH, 12 * INCH], ARCH_B: [12 * INCH, 18 * INCH], ARCH_C: [18 * INCH, 24 * INCH],
+    ARCH_D: [24 * INCH, 36 * INCH], ARCH_E: [36 * INCH, 48 * INCH], ARCH_E1: [30 * INCH, 42 * INCH],
+    ARCH_E2: [26 * INCH, 38 * INCH], ARCH_E3: [27 * INCH, 39 * INCH],
+    POSTCARD: [100 * MM, 148 * MM], EXECUTIVE: [7.25 * INCH, 10.5 * INCH],
+};
+
+const CAPTION_SIZE = 12.0;
+
+export interface PageGeometry {
+    width: number;
+    height: number;
+    // top, right, bottom, left
+    margins: [number, number, number, number];
+    // Resolution of the maps on the page; overrides the maps' own ppi, as in the PDF emitter.
+    ppi: number | undefined;
+}
+
+export interface Placement {
+    x: number;
+    y: number;
+    width: number;
+    height: number;
+    caption: { text: string, x: number, y: number, size: number } | undefined;
+}
+
+/**
+ * Page size and margins in points. physicalSize (pageSize CUSTOM) is given in millimetres,
+ * margins in points, following CSS shorthand order.
+ */
+export function pageGeometry(page: Territorium.Page): PageGeometry {
+    let size: [number, number] = PAGE_SIZES['A4']!;
+    if (page.pageSize === 'CUSTOM' && page.physicalSize !== undefined && page.physicalSize !== null)
+        size = [page.physicalSize[0] * MM, page.physicalSize[1] * MM];
+    else if (page.pageSize !== undefined && page.pageSize !== null && PAGE_SIZES[page.pageSize] !== undefined)
+        size = PAGE_SIZES[page.pageSize]!;
+
+    let [width, height] = size;
+    if ((page.orientation === 'landscape') !== (width > height))
+        [width, height] = [height, width];
+
+    let margins: [number, number, number, number] = [36.0, 36.0, 36.0, 36.0];
+    const m = page.margins;
+    if (typeof m === 'number')
+        margins = [m, m, m, m];
+    else if (m instanceof Array && m.length === 2)
+        margins = [m[0], m[1], m[0], m[1]];
+    else if (m instanceof Array && m.length === 4)
+        margins = [m[0], m[1], m[2], m[3]];
+
+    const ppi = page.ppi !== undefined && page.ppi !== null && page.ppi > 0 ? page.ppi : undefined;
+    return {width: width, height: height, margins: margins, ppi: ppi};
+}
+
+/**
+ * Places one map per page inside the margins: natural size from its pixel size and the page's
+ * ppi (or the map's own ppi if the page has none), shrunk to fit, centered horizontally below
+ * an optional caption.
+ */
+export function placeOnPage(geometry: PageGeometry, size: [number, number], ppi: number, caption: string | undefined): Placement {
+    const [top, right, bottom, left] = geometry.margins;
+    let y = top;
+    let captionPlacement = undefined;
+    if (caption !== undefined && caption !== '') {
+        captionPlacement = {text: caption, x: left, y: top + CAPTION_SIZE, size: CAPTION_SIZE};
+        y += CAPTION_SIZE * 2;
+    }
+    const boxWidth = Math.max(1, geometry.width - left - right);
+    const boxHeight = Math.max(1, geometry.height - y - bottom);
+    const scale = Math.min(72.0 / (geometry.ppi ?? ppi), boxWidth / size[0], boxHeight / size[1]);
+    const width = size[0] * scale;
+    return {
+        x: left + (boxWidth - width) / 2,
+        y: y,
+        width: width,
+        height: size[1] * scale,
+        caption: captionPlacement
+    };
+}
+
 export async function buildPdf(page: Territorium.Page, buffers: Array<Territorium.ResultBuffer>) {
 
     const buffersBase64 = buffers.map(item => ({
@@ -35,8 +35,10 @@ function createLib(libraryPath = `./libwrapper.${suffix}`) {
         // map
         map_new: {args: [FFIType.i32, FFIType.i32], returns: FFIType.ptr},
         map_free: {args: [FFIType.ptr], returns: FFIType.void},
+        map_clone: {args: [FFIType.ptr, FFIType.i32, FFIType.i32], returns: FFIType.ptr},
         map_load: {args: [FFIType.ptr, FFIType.ptr], returns: FFIType.i32},
         map_load_string: {args: [FFIType.ptr, FFIType.cstring, FFIType.cstring], returns: FFIType.i32},
+        map_load_string_as: {args: [FFIType.ptr, FFIType.cstring, FFIType.cstring], returns: FFIType.i32},
         map_zoom_all: {args: [FFIType.ptr], returns: FFIType.void},
         map_zoom_to_box: {
             args: [FFIType.ptr, FFIType.f64, FFIType.f64, FFIType.f64, FFIType.f64],
@@ -54,11 +56,21 @@ function createLib(libraryPath = `./libwrapper.${suffix}`) {
         map_width: {args: [FFIType.ptr], returns: FFIType.i32},
         map_height: {args: [FFIType.ptr], returns: FFIType.i32},
         map_get_extent: {args: [FFIType.ptr, FFIType.ptr], returns: FFIType.i32},
+        map_get_srs: {args: [FFIType.ptr], returns: FFIType.cstring},
+        map_save_string: {args: [FFIType.ptr], returns: FFIType.cstring},
+        map_render_tiled: {args: [FFIType.ptr, FFIType.ptr, FFIType.i32], returns: FFIType.i32},
+        map_render_mvt: {
+            args: [FFIType.ptr, FFIType.i32, FFIType.i32, FFIType.i32, FFIType.cstring, FFIType.ptr],
+            returns: FFIType.ptr
+        },
         // image
         image_new: {args: [FFIType.i32, FFIType.i32], returns: FFIType.ptr},
         image_free: {args: [FFIType.ptr], returns: FFIType.void},
         image_save: {args: [FFIType.ptr, FFIType.cstring, FFIType.cstring], returns: FFIType.void},
         image_encode_to_memory: {args: [FFIType.ptr, FFIType.cstring, FFIType.ptr], returns: FFIType.ptr},
+        image_resize_box: {args: [FFIType.ptr, FFIType.i32, FFIType.i32], returns: FFIType.ptr},
+        image_crop: {args: [FFIType.ptr, FFIType.i32, FFIType.i32, FFIType.i32, FFIType.i32], returns: FFIType.ptr},
+        render_memory_estimate: {args: [FFIType.i32, FFIType.i32, FFIType.i32], returns: FFIType.u64},
 
         // layer
         layer_new: {args: [FFIType.cstring, FFIType.cstring], returns: FFIType.ptr},
@@ -70,6 +82,7 @@ function createLib(libraryPath = `./libwrapper.${suffix}`) {
         // datasource
         datasource_register_plugin_dir: {args: [FFIType.cstring], returns: FFIType.i32},
         datasource_is_valid: {args: [FFIType.ptr], returns: FFIType.i32},
+        datasource_get_extent: {args: [FFIType.ptr, FFIType.ptr], returns: FFIType.i32},
         datasource_free: {args: [FFIType.ptr], returns: FFIType.void},
 
         datasource_shape_new: {args: [FFIType.cstring, FFIType.cstring, FFIType.cstring], returns: FFIType.ptr},
@@ -96,6 +109,43 @@ function createLib(libraryPath = `./libwrapper.${suffix}`) {
         fonts_face_names: {args: [], returns: FFIType.cstring},
         fonts_get_cache: {args: [], returns: FFIType.cstring},
         fonts_get_mapping: {args: [], returns: FFIType.cstring},
+        fonts_prewarm: {args: [FFIType.cstring], returns: FFIType.i32},
+
+        // projection cache
+        proj_cache_stats: {args: [], returns: FFIType.cstring},
+        datasource_projected_new: {args: [FFIType.ptr, FFIType.cstring, FFIType.cstring], returns: FFIType.ptr},
+
+        // feature cache
+        feature_cache_configure: {args: [FFIType.u64, FFIType.u32], returns: FFIType.void},
+        feature_cache_clear: {args: [], returns: FFIType.void},
+        feature_cache_stats: {args: [], returns: FFIType.cstring},
+        map_enable_feature_cache: {args: [FFIType.ptr, FFIType.cstring], returns: FFIType.i32},
+
+        // preview profile
+        map_derive_preview: {args: [FFIType.ptr, FFIType.f64, FFIType.cstring], returns: FFIType.i32},
+
+        // pdf document
+        pdf_document_new: {args: [FFIType.f64, FFIType.f64], returns: FFIType.ptr},
+        pdf_document_free: {args: [FFIType.ptr], returns: FFIType.void},
+        pdf_document_begin_page: {args: [FFIType.ptr, FFIType.f64, FFIType.f64], returns: FFIType.i32},
+        pdf_document_place_map: {
+            args: [FFIType.ptr, FFIType.ptr, FFIType.f64, FFIType.f64, FFIType.f64, FFIType.f64, FFIType.f64],
+            returns: FFIType.i32
+        },
+        pdf_document_add_text: {
+            args: [FFIType.ptr, FFIType.cstring, FFIType.f64, FFIType.f64, FFIType.f64],
+            returns: FFIType.i32
+        },
+        pdf_document_finish: {args: [FFIType.ptr, FFIType.ptr], returns: FFIType.ptr},
+
+        // preloaded file datasources
+        map_file_datasources: {args: [FFIType.ptr], returns: FFIType.cstring},
+        map_preload_file_datasources: {args: [FFIType.ptr], returns: FFIType.i32},
+        map_use_preloaded_datasources: {args: [FFIType.ptr], returns: FFIType.i32},
+        file_datasource_claim: {args: [FFIType.cstring], returns: FFIType.i32},
+        file_datasource_release: {args: [FFIType.cstring], returns: FFIType.void},
+        file_datasource_wait: {args: [FFIType.cstring], returns: FFIType.i32},
+        file_datasource_stats: {args: [], returns: FFIType.cstring},
     });
 
     const api = lib.symbols;
@@ -209,6 +259,12 @@ export class Datasource extends NativeHandle {
         }
     }
 
+    get extent(): [number, number, number, number] {
+        const out = new Float64Array(4);
+        this.lib.okOrThrow(this.lib.api.datasource_get_extent(this.handle, ptr(out)), "datasource_get_extent");
+        return [out[0] ?? 0, out[1] ?? 0, out[2] ?? 0, out[3] ?? 0];
+    }
+
     static registerPluginDir(lib: Lib, path: string): void {
         const pathZ = toNullTerminatedUtf8(path);
         lib.okOrThrow(lib.api.datasource_register_plugin_dir(ptr(pathZ)), "datasource_register_plugin_dir");
@@ -240,6 +296,16 @@ export class Datasource extends NativeHandle {
         return new Datasource(lib, _ptr);
     }
 
+    /** Features of ds projected once from sourceSrs into targetSrs; shares ds if both are equivalent. */
+    static projected(lib: Lib, ds: Datasource, sourceSrs: string, targetSrs: string): Datasource {
+        lib.clearError();
+        const sourceZ = toNullTerminatedUtf8(sourceSrs);
+        const targetZ = toNullTerminatedUtf8(targetSrs);
+        const _ptr = lib.api.datasource_projected_new(ds.handle, ptr(sourceZ), ptr(targetZ));
+        assertPtr(_ptr, `datasource_projected_new returned null: ${lib.lastError()}`);
+        return new Datasource(lib, _ptr);
+    }
+
     static postgis(lib: Lib, opts: PostgisOptions): Datasource {
         lib.clearError();
         const hostZ = toNullTerminatedUtf8(opts.host);
@@ -343,13 +409,35 @@ export class Image extends NativeHandle {
         this.lib.api.image_free(ptr);
     }
 
-    constructor(lib: Lib, width: number, height: number) {
-        const ptr = lib.api.image_new(width, height);
+    readonly width: number;
+    readonly height: number;
+
+    // handle: an already allocated image_rgba8 of the given size to take ownership of.
+    constructor(lib: Lib, width: number, height: number, handle: Pointer | null = null) {
+        const ptr = handle ?? lib.api.image_new(width, height);
         assertPtr(ptr, "image_new returned null");
         super(lib, ptr);
+        this.width = width;
+        this.height = height;
         Image.finalizer.register(this, {lib, ptr}, this);
     }
 
+    /** Downsampled copy using an area-average (box) filter; only sizes up to the current size. */
+    resize(width: number, height: number): Image {
+        this.lib.clearError();
+        const p = this.lib.api.image_resize_box(this.handle, Math.round(width), Math.round(height));
+        assertPtr(p, `image_resize_box returned null: ${this.lib.lastError()}`);
+        return new Image(this.lib, Math.round(width), Math.round(height), p);
+    }
+
+    /** Copy of the rectangle (x, y, width, height). */
+    crop(x: number, y: number, width: number, height: number): Image {
+        this.lib.clearError();
+        const p = this.lib.api.image_crop(this.handle, x, y, width, height);
+        assertPtr(p, `image_crop returned null: ${this.lib.lastError()}`);
+        return new Image(this.lib, width, height, p);
+    }
+
     save(path: string, format: string = "png"): void {
         const pathZ = toNullTerminatedUtf8(path);
         const formatZ = toNullTerminatedUtf8(format);
@@ -398,14 +486,23 @@ export class Map extends NativeHandle {
         this.lib.api.map_free(ptr);
     }
 
-    constructor(lib: Lib, width: number, height: number) {
+    // handle: an already allocated map to take ownership of.
+    constructor(lib: Lib, width: number, height: number, handle: Pointer | null = null) {
         lib.clearError();
-        const ptr = lib.api.map_new(width, height);
+        const ptr = handle ?? lib.api.map_new(width, height);
         assertPtr(ptr, `map_new returned null: ${lib.lastError()}`);
         super(lib, ptr);
         Map.finalizer.register(this, {lib, ptr}, this);
     }
 
+    /** Copy at another size; styles and layers are copied, datasources are shared with this map. */
+    clone(width: number, height: number): Map {
+        this.lib.clearError();
+        const p = this.lib.api.map_clone(this.handle, width, height);
+        assertPtr(p, `map_clone returned null: ${this.lib.lastError()}`);
+        return new Map(this.lib, width, height, p);
+    }
+
     get width(): number {
         return this.lib.api.map_width(this.handle);
     }
@@ -420,6 +517,18 @@ export class Map extends NativeHandle {
         return [out[0] ?? 0, out[1] ?? 0, out[2] ?? 0, out[3] ?? 0];
     }
 
+    get srs(): string {
+        return (this.lib.api.map_get_srs(this.handle) as unknown as string) || "";
+    }
+
+    /** The map serialized as Mapnik XML. */
+    toXml(): string {
+        this.lib.clearError();
+        const xml = (this.lib.api.map_save_string(this.handle) as unknown as string) || "";
+        if (xml === "") throw new Error(`map_save_string: ${this.lib.lastError()}`);
+        return xml;
+    }
+
     load(path: string): this {
         const pathZ = toNullTerminatedUtf8(path);
         this.lib.okOrThrow(this.lib.api.map_load(this.handle, ptr(pathZ)), "map_load");
@@ -433,6 +542,14 @@ export class Map extends NativeHandle {
         return this;
     }
 
+    /** Loads xml like load(filename) would load the file: not strict, relative paths next to filename. */
+    loadStringAs(xml: string, filename: string): this {
+        const xmlZ = toNullTerminatedUtf8(xml);
+        const fileZ = toNullTerminatedUtf8(filename);
+        this.lib.okOrThrow(this.lib.api.map_load_string_as(this.handle, ptr(xmlZ), ptr(fileZ)), "map_load_string_as");
+        return this;
+    }
+
     loadFonts(): this {
         this.lib.okOrThrow(this.lib.api.map_load_fonts(this.handle), "map_load_fonts");
         return this;
@@ -487,6 +604,31 @@ export class Map extends NativeHandle {
         return this;
     }
 
+    /**
+     * Renders in tiles of tileSize x tileSize pixels when the map has more pixels than that, with
+     * the same result as render(). Each tile queries and places labels for the whole map.
+     */
+    renderTiled(image: Image, tileSize: number): this {
+        this.lib.okOrThrow(this.lib.api.map_render_tiled(this.handle, image.handle, tileSize), "map_render_tiled");
+        return this;
+    }
+
+    /** Mapbox Vector Tile for z/x/y with the given layers (all active layers if empty). */
+    renderMvt(z: number, x: number, y: number, layers: string[] = []): Buffer {
+        this.lib.clearError();
+        const outLenBuf = new BigUint64Array(1);
+        const layersZ = toNullTerminatedUtf8(layers.join(','));
+        const p = this.lib.api.map_render_mvt(this.handle, z, x, y, ptr(layersZ), ptr(outLenBuf));
+        assertPtr(p, `map_render_mvt returned null: ${this.lib.lastError()}`);
+        try {
+            const len = Number(outLenBuf[0]);
+            if (len === 0) return Buffer.alloc(0);
+            return Buffer.from(new Uint8Array(toArrayBuffer(p, 0, len)).slice());
+        } finally {
+            this.lib.api.mem_free(p);
+        }
+    }
+
     renderSvg(path: string): this {
         const p = toNullTerminatedUtf8(path);
         this.lib.okOrThrow(this.lib.api.map_render_svg(this.handle, ptr(p)), "map_render_svg");
@@ -516,8 +658,184 @@ export class Map extends NativeHandle {
         this.lib.okOrThrow(this.lib.api.map_render_pdf(this.handle, ptr(p)), "map_render_pdf");
         return this;
     }
+
+    /**
+     * Reduces the loaded style to a fast preview: labels and buildings are removed, geometries
+     * simplified by simplifyTolerance pixels and image filters dropped. Layers without anything
+     * left to draw, and the named dropLayers, are removed. Call after load() and before adding
+     * overlays; returns the number of removed layers.
+     */
+    derivePreview(simplifyTolerance: number = 1.5, dropLayers: string[] = []): number {
+        const dropZ = toNullTerminatedUtf8(dropLayers.join('\n'));
+        const removed = this.lib.api.map_derive_preview(this.handle, simplifyTolerance, ptr(dropZ));
+        if (removed < 0) throw new Error(`map_derive_preview: ${this.lib.lastError()}`);
+        return removed;
+    }
+
+    /**
+     * Routes all layers of the given datasource types (PostGIS by default) currently in the map
+     * through the process-wide feature cache. Call after load()/loadString(). Returns the number
+     * of wrapped layers.
+     */
+    enableFeatureCache(types: string[] = ['postgis']): number {
+        const typesZ = toNullTerminatedUtf8(types.join(','));
+        const wrapped = this.lib.api.map_enable_feature_cache(this.handle, ptr(typesZ));
+        if (wrapped < 0) throw new Error(`map_enable_feature_cache: ${this.lib.lastError()}`);
+        return wrapped;
+    }
+
+    /** Shape/GeoJSON datasources of the loaded map with their spatial index status. */
+    get fileDatasources(): FileDatasourceInfo[] {
+        const json = this.lib.api.map_file_datasources(this.handle) as unknown as string;
+        return JSON.parse(json || "[]");
+    }
+
+    /** Registers the map's file datasources as shared, memory-mapped instances for this process. */
+    preloadFileDatasources(): number {
+        const added = this.lib.api.map_preload_file_datasources(this.handle);
+        if (added < 0) throw new Error(`map_preload_file_datasources: ${this.lib.lastError()}`);
+        return added;
+    }
+
+    /** Replaces file datasources with the preloaded shared instances. Call after load(). */
+    usePreloadedDatasources(): number {
+        const replaced = this.lib.api.map_use_preloaded_datasources(this.handle);
+        if (replaced < 0) throw new Error(`map_use_preloaded_datasources: ${this.lib.lastError()}`);
+        return replaced;
+    }
+}
+
+// -----------------------------
+// PdfDocument
+// -----------------------------
+
+/** Multi-page vector PDF; all coordinates in points, origin top left. */
+export class PdfDocument extends NativeHandle {
+    private static finalizer = new FinalizationRegistry<{ lib: Lib; ptr: Pointer }>((v) => {
+        try {
+            v.lib.api.pdf_document_free(v.ptr);
+        } catch {
+            // ignore
+        }
+    });
+
+    protected _free(ptr: Pointer): void {
+        PdfDocument.finalizer.unregister(this);
+        this.lib.api.pdf_document_free(ptr);
+    }
+
+    constructor(lib: Lib, width: number, height: number) {
+        lib.clearError();
+        const ptr = lib.api.pdf_document_new(width, height);
+        assertPtr(ptr, `pdf_document_new returned null: ${lib.lastError()}`);
+        super(lib, ptr);
+        PdfDocument.finalizer.register(this, {lib, ptr}, this);
+    }
+
+    beginPage(width: number, height: number): this {
+        this.lib.okOrThrow(this.lib.api.pdf_document_begin_page(this.handle, width, height), "pdf_document_begin_page");
+        return this;
+    }
+
+    placeMap(map: Map, x: number, y: number, width: number, height: number, scaleFactor: number = 1.0): this {
+        this.lib.okOrThrow(
+            this.lib.api.pdf_document_place_map(this.handle, map.handle, x, y, width, height, scaleFactor),
+            "pdf_document_place_map",
+        );
+        return this;
+    }
+
+    addText(text: string, x: number, y: number, size: number = 12): this {
+        const textZ = toNullTerminatedUtf8(text);
+        this.lib.okOrThrow(this.lib.api.pdf_document_add_text(this.handle, ptr(textZ), x, y, size), "pdf_document_add_text");
+        return this;
+    }
+
+    finish(): Buffer {
+        const outLenBuf = new BigUint64Array(1);
+        const p = this.lib.api.pdf_document_finish(this.handle, ptr(outLenBuf));
+        if (!p || p === 0) {
+            throw new Error(`pdf_document_finish: ${this.lib.lastError()}`);
+        }
+
+        try {
+            const len = Number(outLenBuf[0]);
+            return Buffer.from(new Uint8Array(toArrayBuffer(p, 0, len)).slice());
+        } finally {
+            this.lib.api.mem_free(p);
+        }
+    }
 }
 
+// -----------------------------
+// Fonts
+// -----------------------------
+
+export type FontCacheInfo = {
+    count: number;
+    prewarmed: number;
+    // Faces prewarmed for the first time in this process, and again by a later worker.
+    prewarm_loaded: number;
+    prewarm_reused: number;
+    prewarm_failed: number;
+};
+
+// -----------------------------
+// Projection cache
+// -----------------------------
+
+export type ProjCacheStats = {
+    entries: number;
+    identity: number;
+    hits: number;
+    misses: number;
+};
+
+// -----------------------------
+// Feature cache
+// -----------------------------
+
+export type FeatureCacheStats = {
+    budget: number;
+    ttl: number;
+    bytes: number;
+    entries: number;
+    hits: number;
+    misses: number;
+    evictions: number;
+    expired: number;
+    bypassed: number;
+};
+
+// -----------------------------
+// Preloaded file datasources
+// -----------------------------
+
+export type SpatialIndexStatus = 'ok' | 'missing' | 'stale' | 'invalid';
+
+export type FileDatasourceInfo = {
+    layer: string;
+    type: 'shape' | 'geojson';
+    file: string;
+    index: SpatialIndexStatus;
+};
+
+export type FileDatasourceStats = {
+    queries: number;
+    indexed_queries: number;
+    indexed_query_share: number;
+    mapped_bytes: number;
+    files: Array<{
+        type: 'shape' | 'geojson';
+        file: string;
+        index: SpatialIndexStatus;
+        indexed: boolean;
+        mapped_bytes: number;
+        queries: number;
+        features: number;
+    }>;
+};
+
 // -----------------------------
 // Facade: Mapnik (lib singleton)
 // -----------------------------
@@ -561,11 +879,69 @@ export class Mapnik {
         return JSON.parse(json || "{}");
     }
 
-    get fontCacheInfo(): any {
+    get fontCacheInfo(): FontCacheInfo {
         const json = this.lib.api.fonts_get_cache() as unknown as string;
         return JSON.parse(json || "{}");
     }
 
+    /** Loads the given faces into the process-wide font cache; returns how many could be opened. */
+    prewarmFonts(faces: string[]): number {
+        this.lib.clearError();
+        const facesZ = toNullTerminatedUtf8(faces.join('\n'));
+        const count = this.lib.api.fonts_prewarm(ptr(facesZ));
+        if (count < 0) throw new Error(`fonts_prewarm: ${this.lib.lastError()}`);
+        return count;
+    }
+
+    /** ttlSeconds of 0 keeps entries until they are evicted or the cache is cleared. */
+    configureFeatureCache(budgetBytes: number, ttlSeconds: number = 0): void {
+        this.lib.api.feature_cache_configure(BigInt(Math.max(0, Math.floor(budgetBytes))), Math.max(0, Math.floor(ttlSeconds)));
+    }
+
+    clearFeatureCache(): void {
+        this.lib.api.feature_cache_clear();
+    }
+
+    get featureCacheStats(): FeatureCacheStats {
+        const json = this.lib.api.feature_cache_stats() as unknown as string;
+        return JSON.parse(json || "{}");
+    }
+
+    get projCacheStats(): ProjCacheStats {
+        const json = this.lib.api.proj_cache_stats() as unknown as string;
+        return JSON.parse(json || "{}");
+    }
+
+    /** Estimated peak native memory in bytes for rendering a map of the given size. */
+    renderMemoryEstimate(width: number, height: number, vector: boolean = false): number {
+        return Number(this.lib.api.render_memory_estimate(width, height, vector ? 1 : 0));
+    }
+
+    /**
+     * True for the first caller in this process claiming the file, e.g. to build its index.
+     * The claimer must call releaseFile() when done; waitForFiles() blocks until then.
+     */
+    claimFile(file: string): boolean {
+        const fileZ = toNullTerminatedUtf8(file);
+        return this.lib.api.file_datasource_claim(ptr(fileZ)) === 1;
+    }
+
+    releaseFile(file: string): void {
+        const fileZ = toNullTerminatedUtf8(file);
+        this.lib.api.file_datasource_release(ptr(fileZ));
+    }
+
+    /** Waits until no other thread holds a claim on the files; false if that timed out. */
+    waitForFiles(files: string[]): boolean {
+        const filesZ = toNullTerminatedUtf8(files.join('\n'));
+        return this.lib.api.file_datasource_wait(ptr(filesZ)) === 1;
+    }
+
+    get fileDatasourceStats(): FileDatasourceStats {
+        const json = this.lib.api.file_datasource_stats() as unknown as string;
+        return JSON.parse(json || "{}");
+    }
+
     get supports(): { cairo: boolean } {
         return {cairo: this.lib.api.supports_cairo() === 1};
     }
@@ -582,6 +958,10 @@ export class Mapnik {
         return new Layer(this.lib, name, srs);
     }
 
+    PdfDocument(width: number, height: number): PdfDocument {
+        return new PdfDocument(this.lib, width, height);
+    }
+
     Datasource = {
         shape: (file: string, encoding: string | null = "UTF-8", base: string | null = null) =>
             Datasource.shape(this.lib, file, encoding, base),
@@ -590,5 +970,7 @@ export class Mapnik {
         csvFile: (file: string, base: string | null = null) => Datasource.csvFile(this.lib, file, base),
         csvInline: (csv: string) => Datasource.csvInline(this.lib, csv),
         postgis: (opts: PostgisOptions) => Datasource.postgis(this.lib, opts),
+        projected: (ds: Datasource, sourceSrs: string, targetSrs: string) =>
+            Datasource.projected(this.lib, ds, sourceSrs, targetSrs),
     };
 }
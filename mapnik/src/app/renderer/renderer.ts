@@ -16,21 +16,29 @@
 
 import {v4 as uuidv4} from 'uuid';
 import * as fs from 'node:fs';
+import * as os from 'node:os';
 import {
     addCopyrightTextRaster,
     addCopyrightTextVector,
+    COPYRIGHT_TEXT,
     createLayers,
     createStyles,
     createTextStyle,
     createUniqueStyles,
+    DEFAULT_FONT,
+    derivativeSizes,
     generateWorldFile,
     getInline,
-    mergeLayers
+    mergeLayers,
+    withDatasourceParameters
 } from "./utils.ts";
-import type {AbstractRenderer, Territorium} from "../index.d.ts";
+import type {AbstractRenderer, RenderedDerivative, RenderResult, Territorium} from "../index.d.ts";
 import {parentPort} from "node:worker_threads";
+import {pageGeometry, placeOnPage} from "./container.ts";
 
-import {LogLevel, Map, Mapnik} from './mapnik.ts';
+import {type AtlasEntry, planAtlas} from "./atlas.ts";
+
+import {Image, LogLevel, Map, Mapnik} from './mapnik.ts';
 
 let fontsDirectory = process.env.FONT_DIRECTORY ?? '';
 if (fontsDirectory === '')
@@ -44,43 +52,186 @@ if (osmStyle === '')
 else if (osmStyle === 'de')
     osmStyle = '/input/osm-de.xml';
 
+let featureCacheMb = Number(process.env.FEATURE_CACHE_MB ?? '');
+if (process.env.FEATURE_CACHE_MB === undefined || process.env.FEATURE_CACHE_MB === '' || isNaN(featureCacheMb))
+    featureCacheMb = 256;
+// Cached features expire after this many seconds, so a database re-import shows up without a restart (0 = never).
+let featureCacheTtl = Number(process.env.FEATURE_CACHE_TTL ?? '');
+if (process.env.FEATURE_CACHE_TTL === undefined || process.env.FEATURE_CACHE_TTL === '' || isNaN(featureCacheTtl))
+    featureCacheTtl = 3600;
+
+// Concurrent PostGIS queries per render (max_async_connection, set when the style is loaded):
+// Mapnik sends the SQL of every visible layer before drawing the first one and draws each
+// layer as its rows arrive. 1 restores strictly sequential queries.
+let queryConcurrency = Number(process.env.QUERY_CONCURRENCY ?? '');
+if (process.env.QUERY_CONCURRENCY === undefined || process.env.QUERY_CONCURRENCY === '' || isNaN(queryConcurrency))
+    queryConcurrency = 4;
+
+let atlasMode = (process.env.ATLAS_MODE ?? '') === 'true';
+let atlasTileSize = Number(process.env.ATLAS_TILE_SIZE ?? '');
+if (process.env.ATLAS_TILE_SIZE === undefined || process.env.ATLAS_TILE_SIZE === '' || isNaN(atlasTileSize))
+    atlasTileSize = 4096;
+let atlasMaxPixels = Number(process.env.ATLAS_MAX_PIXELS ?? '');
+if (process.env.ATLAS_MAX_PIXELS === undefined || process.env.ATLAS_MAX_PIXELS === '' || isNaN(atlasMaxPixels))
+    atlasMaxPixels = 256 * 1024 * 1024;
+
+// Base layers of the style included in vector tiles besides the overlays (comma separated layer names).
+let mvtBaseLayers = (process.env.MVT_BASE_LAYERS ?? '').split(',').map(l => l.trim()).filter(l => l !== '');
+
+// Preview profile: simplification in pixels and layers of the style dropped besides the label-only ones.
+let previewSimplify = Number(process.env.PREVIEW_SIMPLIFY ?? '');
+if (process.env.PREVIEW_SIMPLIFY === undefined || process.env.PREVIEW_SIMPLIFY === '' || isNaN(previewSimplify))
+    previewSimplify = 1.5;
+let previewDropLayers = (process.env.PREVIEW_DROP_LAYERS ?? '').split(',').map(l => l.trim()).filter(l => l !== '');
+if (process.env.PREVIEW_DROP_LAYERS === undefined || process.env.PREVIEW_DROP_LAYERS === '')
+    previewDropLayers = ['amenity-points', 'amenity-low-priority', 'trees', 'entrances', 'addresses',
+        'power-line', 'power-minorline', 'power-towers', 'aerialways', 'turning-circle-casing', 'turning-circle-fill'];
+
+let nativePdf = (process.env.PDF_NATIVE ?? '') !== 'false';
+
+// 'style' prewarms the faces referenced by the style, 'false' disables, anything else is a comma separated list.
+let fontPrewarm = process.env.FONT_PREWARM ?? '';
+if (fontPrewarm === '')
+    fontPrewarm = 'style';
+
+let preloadFiles = (process.env.PRELOAD_FILE_DATASOURCES ?? '') !== 'false';
+let shapeIndex = process.env.SHAPEINDEX ?? '';
+if (shapeIndex === '')
+    shapeIndex = 'shapeindex';
+
 export class Renderer implements AbstractRenderer {
 
     private srs = '+proj=merc +a=6378137 +b=6378137 +lat_ts=0.0 +lon_0=0.0 +x_0=0.0 +y_0=0 +k=1.0 +units=m +nadgrids=@null +no_defs +over';
     private mapnik = new Mapnik();
+    private templates: Record<string, Map> = {};
 
     constructor() {
         this.mapnik.setLogLevel(LogLevel.Error);
         this.mapnik.registerPluginDir(pluginDirectory);
         this.mapnik.registerDefaultFontDir();
         this.mapnik.registerFontDir(fontsDirectory, true);
+        this.mapnik.configureFeatureCache(featureCacheMb * 1024 * 1024, featureCacheTtl);
         parentPort?.postMessage(this.mapnik.version());
+        if (fontPrewarm !== 'false')
+            this.prewarmFonts();
+        if (preloadFiles)
+            this.prepareFileDatasources();
     }
 
-    private addAdditionalLayers(m: Map, layers: Array<Territorium.Layer>, inline: string) {
+    private prewarmFonts() {
+        let faces = new Set<string>([DEFAULT_FONT]);
+        try {
+            if (fontPrewarm === 'style') {
+                for (const match of fs.readFileSync(osmStyle, 'utf-8').matchAll(/face-name="([^"]+)"/g))
+                    faces.add(match[1]!);
+            } else {
+                for (const face of fontPrewarm.split(','))
+                    if (face.trim() !== '')
+                        faces.add(face.trim());
+            }
+            let count = this.mapnik.prewarmFonts([...faces]);
+            let info = this.mapnik.fontCacheInfo;
+            parentPort?.postMessage(`Prewarmed ${count} of ${faces.size} font faces (${info.count} font files cached)`);
+        } catch (e) {
+            parentPort?.postMessage({error: true, message: `Prewarming fonts failed: ${e}`});
+        }
+    }
 
+    private prepareFileDatasources() {
+        try {
+            let shapes: string[] = [];
+            {
+                using probe = this.mapnik.Map(1, 1);
+                probe.load(osmStyle);
+                for (const ds of probe.fileDatasources) {
+                    if (ds.type !== 'shape')
+                        continue;
+                    shapes.push(ds.file);
+                    if (ds.index === 'ok' || !this.mapnik.claimFile(ds.file))
+                        continue;
+                    try {
+                        const proc = Bun.spawnSync([shapeIndex, ds.file]);
+                        if (proc.exitCode !== 0)
+                            parentPort?.postMessage({error: true, message: `${shapeIndex} failed for ${ds.file}`});
+                    } catch (e) {
+                        parentPort?.postMessage({error: true, message: `${shapeIndex} not available: ${e}`});
+                        break;
+                    } finally {
+                        this.mapnik.releaseFile(ds.file);
+                    }
+                }
+            }
+            // Indexes may still be written by other workers. The shapefile datasources look for
+            // their index when they are built, so the shared instances come from a fresh load.
+            if (!this.mapnik.waitForFiles(shapes))
+                parentPort?.postMessage({error: true, message: 'Timed out waiting for shape indexes of other workers'});
+            using probe = this.mapnik.Map(1, 1);
+            probe.load(osmStyle);
+            let count = probe.preloadFileDatasources();
+            parentPort?.postMessage(`Preloaded ${count} file datasources`);
+        } catch (e) {
+            parentPort?.postMessage({error: true, message: `Preloading file datasources failed: ${e}`});
+        }
+    }
+
+    private addAdditionalLayers(m: Map, layers: Array<Territorium.Layer>, inline: string): string[] {
+
+        // Overlays are projected into the map SRS once (with a cached transform), so the layers
+        // share the map SRS and Mapnik renders them without a per-layer transform.
+        const srs = m.srs || this.srs;
         let i = 0;
 
         for (const l of layers) {
-            let ds = this.mapnik.Datasource.geojsonInline(JSON.stringify(l.way));
-            let layer = this.mapnik.Layer(`border${i}`, this.srs);
+            using raw = this.mapnik.Datasource.geojsonInline(JSON.stringify(l.way));
+            let ds = this.mapnik.Datasource.projected(raw, this.srs, srs);
+            let layer = this.mapnik.Layer(`border${i}`, srs);
             layer.setDatasource(ds);
             layer.addStyle(l.styleName);
             m.addLayer(layer);
             i++;
         }
 
-        let ds_names = this.mapnik.Datasource.csvInline(inline);
-        let layer = this.mapnik.Layer('names', this.srs);
+        using raw_names = this.mapnik.Datasource.csvInline(inline);
+        let ds_names = this.mapnik.Datasource.projected(raw_names, this.srs, srs);
+        let layer = this.mapnik.Layer('names', srs);
         layer.setDatasource(ds_names);
         layer.addStyle('names_style');
         m.addLayer(layer);
+        return [...Array(i).keys()].map(n => `border${n}`).concat('names');
+    }
+
+    // The OSM style loaded once per worker and profile; jobs render on clones of it, so the
+    // style is not parsed and its datasources are not built again for every job.
+    private template(preview: boolean): Map {
+        const profile = preview ? 'preview' : 'full';
+        let template = this.templates[profile];
+        if (template === undefined) {
+            template = this.mapnik.Map(256, 256);
+            if (queryConcurrency > 1)
+                template.loadStringAs(withDatasourceParameters(fs.readFileSync(osmStyle, 'utf-8'), 'postgis', {
+                    max_async_connection: queryConcurrency,
+                    // The pool is shared by every worker thread of the process.
+                    max_size: current => Math.max(Number(current ?? 10), queryConcurrency * os.availableParallelism())
+                }), osmStyle);
+            else
+                template.load(osmStyle);
+            if (preview)
+                template.derivePreview(previewSimplify, previewDropLayers);
+            if (preloadFiles)
+                template.usePreloadedDatasources();
+            if (featureCacheMb > 0)
+                template.enableFeatureCache();
+            this.templates[profile] = template;
+        }
+        return template;
     }
 
-    async map(polygon: Territorium.Polygon): Promise<{
-        map: string | Buffer<ArrayBufferLike>,
-        worldFile: Buffer<ArrayBufferLike>
-    }> {
+    // Base map from the OSM style, without overlays and without an extent.
+    private createBaseMap(width: number, height: number, preview: boolean = false): Map {
+        return this.template(preview).clone(width, height);
+    }
+
+    private addOverlay(map: Map, polygon: Territorium.Polygon): string[] {
         let layers = createLayers(polygon);
         let mergedLayers = mergeLayers(layers);
         let uniqueStyles = createUniqueStyles(polygon);
@@ -89,11 +240,140 @@ export class Renderer implements AbstractRenderer {
         let inline = getInline(layers);
         let styles = `<Map>${lineStyles}${textStyles}</Map>`
 
-        using map = this.mapnik.Map(polygon.size[0], polygon.size[1]);
-        map.load(osmStyle);
-        map.zoomToBox(polygon.bbox);
         map.loadString(styles);
-        this.addAdditionalLayers(map, mergedLayers, inline);
+        return this.addAdditionalLayers(map, mergedLayers, inline);
+    }
+
+    private createMap(polygon: Territorium.Polygon): Map {
+        let map = this.createBaseMap(polygon.size[0], polygon.size[1], polygon.profile === 'preview');
+        map.zoomToBox(polygon.bbox);
+        this.addOverlay(map, polygon);
+        return map;
+    }
+
+    // Overlay only map (transparent background) in the SRS of the base map.
+    private createOverlayMap(polygon: Territorium.Polygon, srs: string): Map {
+        let map = this.mapnik.Map(polygon.size[0], polygon.size[1]);
+        map.loadString(`<Map srs="${srs}"></Map>`);
+        map.zoomToBox(polygon.bbox);
+        this.addOverlay(map, polygon);
+        return map;
+    }
+
+    private async encodeRaster(im: Image, extent: number[], polygon: Territorium.Polygon): Promise<RenderResult> {
+        let src = im.encode('png');
+        if (src !== null) {
+            src = await addCopyrightTextRaster(src, im.width, im.height);
+        }
+        let worldFile = generateWorldFile(extent, im.width, im.height);
+
+        // Previews are downsampled from the rendered image instead of rendering again.
+        let derivatives: Array<RenderedDerivative> = [];
+        for (const size of derivativeSizes(polygon.size, polygon.derivatives)) {
+            using small = im.resize(size[0], size[1]);
+            let buffer = small.encode('png');
+            if (buffer === null)
+                continue;
+            derivatives.push({
+                map: await addCopyrightTextRaster(buffer, size[0], size[1]),
+                worldFile: generateWorldFile(extent, size[0], size[1]),
+                size: size
+            });
+        }
+        return {map: src!, worldFile: worldFile, derivatives: derivatives};
+    }
+
+    /**
+     * Atlas mode: raster polygons sharing a scale get their base map rendered once for the union
+     * extent (in tiles if large). Each polygon is cropped from it and only its overlay is drawn on top.
+     * Returns one entry per polygon; undefined entries are left to map().
+     */
+    async atlas(polygons: Array<Territorium.Polygon>): Promise<Array<RenderResult | undefined>> {
+        let results: Array<RenderResult | undefined> = polygons.map(() => undefined);
+        if (!atlasMode || polygons.length < 2)
+            return results;
+
+        let entries: Array<AtlasEntry> = [];
+        let raster: Array<number> = [];
+        polygons.forEach((polygon, index) => {
+            if (polygon.mediaType !== undefined && polygon.mediaType !== null && polygon.mediaType !== 'image/png')
+                return;
+            if (polygon.profile === 'preview')
+                return;
+            using probe = this.mapnik.Map(polygon.size[0], polygon.size[1]);
+            probe.zoomToBox(polygon.bbox);
+            entries.push({extent: probe.extent, size: polygon.size});
+            raster.push(index);
+        });
+
+        for (const group of planAtlas(entries, atlasMaxPixels)) {
+            const started = performance.now();
+            using base = this.createBaseMap(group.size[0], group.size[1]);
+            base.zoomToBox(group.extent);
+            using canvas = this.mapnik.Image(group.size[0], group.size[1]);
+            base.renderTiled(canvas, atlasTileSize);
+            // Every member is charged an equal share of the shared base map.
+            const shareMs = (performance.now() - started) / group.members.length;
+            parentPort?.postMessage(`Atlas ${group.size[0]}x${group.size[1]} rendered for ${group.members.length} polygons`);
+
+            for (const member of group.members) {
+                const memberStarted = performance.now();
+                const index = raster[member.index]!;
+                const polygon = polygons[index]!;
+                using im = canvas.crop(member.x, member.y, polygon.size[0], polygon.size[1]);
+                using overlay = this.createOverlayMap(polygon, base.srs);
+                overlay.render(im);
+                const result = await this.encodeRaster(im, overlay.extent, polygon);
+                result.renderMs = Math.round(shareMs + performance.now() - memberStarted);
+                results[index] = result;
+            }
+        }
+        return results;
+    }
+
+    /**
+     * Renders all polygons directly onto the pages of one vector PDF, one map per page.
+     * Returns undefined if native composition is unavailable, callers then fall back to the PDF emitter.
+     */
+    async pdf(page: Territorium.Page, polygons: Array<Territorium.Polygon>): Promise<Buffer | undefined> {
+        if (!nativePdf || !this.mapnik.supports.cairo)
+            return undefined;
+
+        const geometry = pageGeometry(page);
+        using document = this.mapnik.PdfDocument(geometry.width, geometry.height);
+        for (const polygon of polygons) {
+            using map = this.createMap(polygon);
+            let ppi = 72.0;
+            if (polygon.style !== undefined && polygon.style !== null && polygon.style.ppi !== undefined && polygon.style.ppi !== null)
+                ppi = polygon.style.ppi;
+            const caption = page.pageDecoration ? polygon.name?.text : undefined;
+            const placement = placeOnPage(geometry, polygon.size, ppi, caption);
+
+            document.beginPage(geometry.width, geometry.height);
+            if (placement.caption !== undefined)
+                document.addText(placement.caption.text, placement.caption.x, placement.caption.y, placement.caption.size);
+            document.placeMap(map, placement.x, placement.y, placement.width, placement.height);
+            document.addText(COPYRIGHT_TEXT, placement.x, placement.y + placement.height + 10, 6);
+        }
+        return document.finish();
+    }
+
+    // Overlays (and the configured base layers) as a Mapbox Vector Tile.
+    private vectorTile(polygon: Territorium.Polygon): RenderResult {
+        if (polygon.tile === undefined || polygon.tile === null)
+            throw new Error('Vector tiles need tile: [z, x, y]');
+        using map = mvtBaseLayers.length > 0 ? this.createBaseMap(256, 256) : this.mapnik.Map(256, 256);
+        if (mvtBaseLayers.length === 0)
+            map.loadString(`<Map srs="${this.srs}"></Map>`);
+        const layers = this.addOverlay(map, polygon).concat(mvtBaseLayers);
+        const [z, x, y] = polygon.tile;
+        return {map: map.renderMvt(z, x, y, layers), worldFile: undefined};
+    }
+
+    async map(polygon: Territorium.Polygon): Promise<RenderResult> {
+        if (polygon.mediaType === 'application/vnd.mapbox-vector-tile')
+            return this.vectorTile(polygon);
+        using map = this.createMap(polygon);
         if (polygon.mediaType === 'image/svg+xml' || polygon.mediaType === 'application/pdf') {
             if (!this.mapnik.supports.cairo) {
                 parentPort?.postMessage({error: true, message: 'So sad... no Cairo'});
@@ -117,12 +397,7 @@ export class Renderer implements AbstractRenderer {
         } else {
             using im = this.mapnik.Image(map.width, map.height);
             map.render(im);
-            let src = im.encode('png');
-            if (src !== null) {
-                src = await addCopyrightTextRaster(src, map.width, map.height);
-            }
-            let worldFile = generateWorldFile(map.extent, map.width, map.height);
-            return {map: src!, worldFile: worldFile};
+            return await this.encodeRaster(im, map.extent, polygon);
         }
     }
 }
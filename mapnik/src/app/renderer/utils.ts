@@ -18,7 +18,8 @@ import * as turf from "@turf/turf";
 import type {Territorium} from "../index.d.ts";
 import sharp from "sharp";
 
-const COPYRIGHT_TEXT = '© OpenStreetMap contributors';
+export const COPYRIGHT_TEXT = '© OpenStreetMap contributors';
+export const DEFAULT_FONT = 'DejaVu Sans Book';
 
 let fontsDirectory = process.env.FONT_DIRECTORY;
 if (fontsDirectory === undefined || fontsDirectory === '')
@@ -177,7 +178,7 @@ export function createStyles(styles: Array<Territorium.Style>): string {
 export function createTextStyle(polygon: Territorium.Polygon): string {
     let s = '';
     let textSize = 12.0;
-    let fontName = 'DejaVu Sans Book';
+    let fontName = DEFAULT_FONT;
     let fontColor = 'white';
 
     if (polygon.name === undefined)
@@ -238,3 +239,58 @@ export function generateWorldFile(bbox: number[], m_width: number, m_height: num
         top_pixel_center_y
     ].map(n => n.toFixed(8)).join('\n') + '\n', 'utf-8');
 }
+
+export function derivativeSizes(size: [number, number], derivatives: Array<Territorium.Derivative> | undefined): Array<[number, number]> {
+    let sizes: Array<[number, number]> = [];
+    if (derivatives === undefined || derivatives === null)
+        return sizes;
+
+    for (const derivative of derivatives) {
+        let scale: number;
+        if (derivative.width !== undefined && derivative.width !== null)
+            scale = derivative.width / size[0];
+        else if (derivative.scale !== undefined && derivative.scale !== null)
+            scale = derivative.scale;
+        else
+            continue;
+        if (!(scale > 0 && scale < 1))
+            continue;
+
+        const width = Math.max(1, Math.round(size[0] * scale));
+        const height = Math.max(1, Math.round(size[1] * scale));
+        if (!sizes.some(s => s[0] === width && s[1] === height))
+            sizes.push([width, height]);
+    }
+    return sizes;
+}
+
+// Sets parameters on every <Datasource> of the given type in a Mapnik XML style, so the
+// datasources are built with them when the style is loaded. Datasources inheriting from a
+// <Datasource name="..."> template through base="..." take the template's type and values.
+// A function receives the value already in the style (if any) and returns the one to use.
+export function withDatasourceParameters(xml: string, type: string, parameters: Record<string, string | number | ((current: string | undefined) => string | number)>): string {
+    const parameter = (name: string) => new RegExp(`<Parameter\\s+name="${name}"\\s*>\\s*(?:<!\\[CDATA\\[)?([^<\\]]*?)(?:\\]\\]>)?\\s*</Parameter>\\s*`);
+    const attribute = (tag: string, name: string) => tag.match(new RegExp(`\\s${name}\\s*=\\s*"([^"]*)"`))?.[1];
+    const value = (body: string, name: string) => body.match(parameter(name))?.[1]?.trim();
+    const datasource = /(<Datasource\b[^>]*>)([\s\S]*?)(<\/Datasource>)/g;
+
+    const templates: Record<string, string> = {};
+    for (const [, open, body] of xml.matchAll(datasource)) {
+        const name = attribute(open!, 'name');
+        if (name !== undefined)
+            templates[name] = body!;
+    }
+
+    return xml.replace(datasource, (block, open: string, body: string, close: string) => {
+        const base = attribute(open, 'base');
+        const inherited = base !== undefined ? templates[base] ?? '' : '';
+        if ((value(body, 'type') ?? value(inherited, 'type')) !== type)
+            return block;
+        for (const [name, setting] of Object.entries(parameters)) {
+            const current = value(body, name) ?? value(inherited, name);
+            const resolved = typeof setting === 'function' ? setting(current) : setting;
+            body = body.replace(parameter(name), '') + `<Parameter name="${name}">${resolved}</Parameter>\n`;
+        }
+        return open + body + close;
+    });
+}
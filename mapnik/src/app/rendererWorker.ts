@@ -15,9 +15,9 @@
  */
 
 import {ThreadWorker} from 'poolifier-web-worker'
-import {parentPort} from 'node:worker_threads';
+import {parentPort, threadId} from 'node:worker_threads';
 import {v4 as uuidv4} from 'uuid';
-import type {AbstractRenderer, Territorium} from "./index.d.ts";
+import type {AbstractRenderer, RenderResult, Territorium} from "./index.d.ts";
 import * as fs from 'node:fs';
 import {Renderer} from "./renderer/renderer.ts";
 import {Renderer as MockRenderer} from './renderer/mockRenderer.ts';
@@ -35,6 +35,17 @@ if (mock === undefined || mock === '') {
     renderer = new MockRenderer();
 }
 
+// Set by the load harness (bench/replay.ts): every worker samples its own JS heap and external
+// buffers and reports the peak since its previous report after each job.
+const reportMemory = process.env.REPORT_WORKER_MEMORY === '1';
+const workerMemory = () => {
+    const usage = process.memoryUsage();
+    return usage.heapUsed + usage.external;
+};
+let memoryPeak = 0;
+if (reportMemory)
+    setInterval(() => memoryPeak = Math.max(memoryPeak, workerMemory()), 50).unref();
+
 export interface Inputs {
     data: string;
     directory: string
@@ -42,7 +53,16 @@ export interface Inputs {
 
 class RendererWorker extends ThreadWorker<Inputs, Territorium.JobResult | undefined> {
     constructor() {
-        super(async (data?: Inputs) => await this.process(data), {
+        super(async (data?: Inputs) => {
+            try {
+                return await this.process(data);
+            } finally {
+                if (reportMemory) {
+                    parentPort?.postMessage({type: 'memory', worker: threadId, peakBytes: Math.max(memoryPeak, workerMemory())});
+                    memoryPeak = 0;
+                }
+            }
+        }, {
             maxInactiveTime: 60000,
         })
     }
@@ -83,11 +103,26 @@ class RendererWorker extends ThreadWorker<Inputs, Territorium.JobResult | undefi
         else
             polygons = job.payload.polygon;
 
-        for (const polygon of polygons) {
-            let comp = await renderer.map(polygon);
+        if (page !== undefined && page.mediaType === 'application/pdf' && renderer.pdf !== undefined) {
+            let buffer = await renderer.pdf(page, polygons);
+            if (buffer !== undefined) {
+                parentPort?.postMessage('PDF build finished (native)');
+                return this.createResult(job, this.pdfDocuments(buffer, dateString, timeString), data?.directory!, false);
+            }
+        }
+
+        let atlas: Array<RenderResult | undefined> = [];
+        if (renderer.atlas !== undefined)
+            atlas = await renderer.atlas(polygons);
+
+        for (const [index, polygon] of polygons.entries()) {
+            const profile = polygon.profile === 'preview' ? 'preview' : 'full';
+            const started = performance.now();
+            let comp = atlas[index] ?? await renderer.map(polygon);
+            const renderMs = comp.renderMs ?? Math.round(performance.now() - started);
             let buffer = comp.map;
             let worldFile = comp.worldFile;
-            parentPort?.postMessage("Rendering finished");
+            parentPort?.postMessage(`Rendering finished (${profile}) in ${renderMs} ms`);
             if (buffer !== undefined) {
                 parentPort?.postMessage(`Buffer size of ${polygon.name.text}: ${(buffer.length / 1024 / 1024).toFixed(3)} MB`);
                 if (page === undefined)
@@ -98,6 +133,8 @@ class RendererWorker extends ThreadWorker<Inputs, Territorium.JobResult | undefi
                             extension = 'svg';
                         else if (polygon.mediaType === 'application/pdf')
                             extension = 'pdf';
+                        else if (polygon.mediaType === 'application/vnd.mapbox-vector-tile')
+                            extension = 'mvt';
                         else
                             extension = 'png';
                     else
@@ -123,8 +160,21 @@ class RendererWorker extends ThreadWorker<Inputs, Territorium.JobResult | undefi
                     outputWorldFile = worldFile;
                 buffers.push({
                     name: name, fileName: fileName, buffer: buffer, worldFile: outputWorldFile,
-                    message: '', size: polygon.size, mediaType: polygon.mediaType, ppi: ppi
+                    message: '', size: polygon.size, mediaType: polygon.mediaType, ppi: ppi,
+                    profile: profile, renderMs: renderMs
                 });
+                // Derivatives are separate results; they never end up as pages of a document.
+                if (page === undefined && comp.derivatives !== undefined) {
+                    for (const derivative of comp.derivatives) {
+                        const suffix = `${derivative.size[0]}x${derivative.size[1]}`;
+                        buffers.push({
+                            name: name, fileName: fileName.replace(`_${dateString}_`, `_${suffix}_${dateString}_`),
+                            buffer: derivative.map,
+                            worldFile: polygon.generateWorldFile ? derivative.worldFile : undefined,
+                            message: '', size: derivative.size, mediaType: polygon.mediaType, ppi: ppi
+                        });
+                    }
+                }
                 count++;
             } else {
                 parentPort?.postMessage({error: true, job: job, message: 'Buffer invalid'});
@@ -133,21 +183,7 @@ class RendererWorker extends ThreadWorker<Inputs, Territorium.JobResult | undefi
         if (page !== undefined) {
             if (page.mediaType === 'application/pdf') {
                 let buffer = await buildPdf(page, buffers);
-                let pdfDocuments: Array<Territorium.ResultBuffer> = [{
-                    fileName: `map_${dateString}_${timeString}.pdf`,
-                    buffer: buffer,
-                    worldFile: undefined,
-                    message: '',
-                    mediaType: 'application/pdf',
-                    name: undefined,
-                    ppi: undefined,
-                    size: undefined
-                }]
-                for (const pdfDocument of pdfDocuments) {
-                    if (pdfDocument.buffer === undefined)
-                        continue;
-                    parentPort?.postMessage(`PDF-Document size: ${(pdfDocument.buffer.length / 1024 / 1024).toFixed(3)} MB`);
-                }
+                let pdfDocuments = this.pdfDocuments(buffer, dateString, timeString);
                 parentPort?.postMessage('PDF build finished');
                 return new Promise((resolve: any) => {
                     resolve(this.createResult(job, pdfDocuments, data?.directory!, false));
@@ -162,6 +198,25 @@ class RendererWorker extends ThreadWorker<Inputs, Territorium.JobResult | undefi
         }
     }
 
+    private pdfDocuments(buffer: Buffer, dateString: string, timeString: string): Array<Territorium.ResultBuffer> {
+        let pdfDocuments: Array<Territorium.ResultBuffer> = [{
+            fileName: `map_${dateString}_${timeString}.pdf`,
+            buffer: buffer,
+            worldFile: undefined,
+            message: '',
+            mediaType: 'application/pdf',
+            name: undefined,
+            ppi: undefined,
+            size: undefined
+        }]
+        for (const pdfDocument of pdfDocuments) {
+            if (pdfDocument.buffer === undefined)
+                continue;
+            parentPort?.postMessage(`PDF-Document size: ${(pdfDocument.buffer.length / 1024 / 1024).toFixed(3)} MB`);
+        }
+        return pdfDocuments;
+    }
+
     private createResult(job: Territorium.Job, buffers: Array<Territorium.ResultBuffer>, directory: string, error: boolean): Territorium.JobResult {
         let jobId = job.job || 'NO_JOB';
         let resultsToSend: Array<Territorium.Result> = [];
@@ -193,6 +248,8 @@ class RendererWorker extends ThreadWorker<Inputs, Territorium.JobResult | undefi
                     result.worldFile = worldFile;
                     result.filename = buffer.fileName;
                     result.mediaType = buffer.mediaType;
+                    result.profile = buffer.profile;
+                    result.renderMs = buffer.renderMs;
                     result.error = error;
                 } catch (e) {
                     result.payload = 'Error writing file';
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2019-2025 Simon Zigelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+import type {Territorium} from './index.d.ts'
+
+export type Lane = 'interactive' | 'bulk';
+
+export interface JobCost {
+    pixels: number;
+    memory: number;
+    polygons: number;
+    lane: Lane;
+}
+
+export type MemoryEstimator = (width: number, height: number, vector: boolean) => number;
+
+export interface SchedulerOptions {
+    maxConcurrent: number;
+    maxPixels: number;
+    maxMemory: number;
+    // Number of consecutive interactive dispatches after which a waiting bulk job gets priority.
+    bulkAging?: number;
+}
+
+// Fallback when the native wrapper is not available (e.g. MOCK mode). Must stay equal to
+// render_memory_estimate in wrapper/image.cpp, which mapnik_logic.test.ts checks.
+export const defaultMemoryEstimate: MemoryEstimator = (width, height, vector) => {
+    if (width <= 0 || height <= 0)
+        return 0;
+    const canvas = width * height * 4;
+    return 32 * 1024 * 1024 + (vector ? canvas / 2 : canvas * 3);
+};
+
+export function estimateJobCost(data: string, estimate: MemoryEstimator, interactivePixels: number): JobCost {
+    let job: Territorium.Job;
+    try {
+        job = JSON.parse(data) as Territorium.Job;
+    } catch {
+        // The worker rejects invalid jobs right away; let them through quickly.
+        return {pixels: 0, memory: 0, polygons: 0, lane: 'interactive'};
+    }
+    let polygons: Array<Territorium.Polygon> = [];
+    if (job.payload !== undefined && job.payload !== null && job.payload.polygon !== undefined && job.payload.polygon !== null) {
+        if (job.payload.polygon instanceof Array)
+            polygons = job.payload.polygon;
+        else
+            polygons.push(job.payload.polygon);
+    }
+
+    let pixels = 0;
+    let memory = 0;
+    // size is already in device pixels (the frontend applies ppi), so ppi needs no extra scaling.
+    for (const polygon of polygons) {
+        const width = polygon.size?.[0] ?? 0;
+        const height = polygon.size?.[1] ?? 0;
+        const vector = polygon.mediaType === 'image/svg+xml' || polygon.mediaType === 'application/pdf'
+            || polygon.mediaType === 'application/vnd.mapbox-vector-tile';
+        pixels += width * height;
+        memory += estimate(width, height, vector);
+    }
+    // Composed PDF documents keep all pages in memory until the document is finished.
+    if (job.payload?.page?.mediaType === 'application/pdf')
+        memory *= 1.5;
+
+    const lane: Lane = polygons.length <= 1 && pixels <= interactivePixels ? 'interactive' : 'bulk';
+    return {pixels: pixels, memory: memory, polygons: polygons.length, lane: lane};
+}
+
+interface Pending<T> {
+    cost: JobCost;
+    task: () => Promise<T>;
+    resolve: (value: T) => void;
+    reject: (reason: any) => void;
+}
+
+/**
+ * Admits jobs in front of the worker pool. Jobs run only while the global pixel and memory
+ * budgets allow it; a job exceeding a budget on its own runs alone. Interactive jobs are
+ * preferred, bulk jobs are promoted after `bulkAging` interactive dispatches so they do not starve.
+ */
+export class JobScheduler<T> {
+    private readonly options: Required<SchedulerOptions>;
+    private readonly lanes: Record<Lane, Array<Pending<T>>> = {interactive: [], bulk: []};
+    private running = 0;
+    private pixels = 0;
+    private memory = 0;
+    private interactiveStreak = 0;
+
+    constructor(options: SchedulerOptions) {
+        this.options = {bulkAging: 4, ...options};
+    }
+
+    get stats() {
+        return {
+            running: this.running,
+            pixels: this.pixels,
+            memory: this.memory,
+            interactive: this.lanes.interactive.length,
+            bulk: this.lanes.bulk.length
+        };
+    }
+
+    schedule(cost: JobCost, task: () => Promise<T>): Promise<T> {
+        return new Promise<T>((resolve, reject) => {
+            this.lanes[cost.lane].push({cost: cost, task: task, resolve: resolve, reject: reject});
+            this.dispatch();
+        });
+    }
+
+    private fits(cost: JobCost): boolean {
+        if (this.running === 0)
+            return true;
+        return this.running < this.options.maxConcurrent
+            && this.pixels + cost.pixels <= this.options.maxPixels
+            && this.memory + cost.memory <= this.options.maxMemory;
+    }
+
+    private next(): Pending<T> | undefined {
+        const interactive = this.lanes.interactive[0];
+        const bulk = this.lanes.bulk[0];
+        const bulkDue = bulk !== undefined && (interactive === undefined || this.interactiveStreak >= this.options.bulkAging);
+
+        if (bulkDue) {
+            if (this.fits(bulk.cost)) {
+                this.interactiveStreak = 0;
+                return this.lanes.bulk.shift();
+            }
+            // Hold back interactive jobs until the overdue bulk job fits, otherwise it never would.
+            if (this.interactiveStreak >= this.options.bulkAging)
+                return undefined;
+        }
+        if (interactive !== undefined && this.fits(interactive.cost)) {
+            this.interactiveStreak++;
+            return this.lanes.interactive.shift();
+        }
+        return undefined;
+    }
+
+    private dispatch() {
+        let pending: Pending<T> | undefined;
+        while ((pending = this.next()) !== undefined) {
+            const job = pending;
+            this.running++;
+            this.pixels += job.cost.pixels;
+            this.memory += job.cost.memory;
+            Promise.resolve()
+                .then(job.task)
+                .then(job.resolve, job.reject)
+                .finally(() => {
+                    this.running--;
+                    this.pixels -= job.cost.pixels;
+                    this.memory -= job.cost.memory;
+                    this.dispatch();
+                });
+        }
+    }
+}
@@ -14,7 +14,7 @@
  * limitations under the License.
  */
 
-import {createLayers, getInline, mergeLayers} from '../app/renderer/utils.ts';
+import {createLayers, derivativeSizes, getInline, mergeLayers, withDatasourceParameters} from '../app/renderer/utils.ts';
 import type {Territorium} from "../app";
 import {Renderer as MockRenderer} from "../app/renderer/mockRenderer.ts";
 import {existsSync} from "node:fs";
@@ -22,6 +22,8 @@ import {describe, expect, test} from "bun:test";
 import {resolve} from "node:path";
 import {rm} from "node:fs/promises";
 import {Mapnik} from "../app/renderer/mapnik.ts";
+import {pageGeometry, placeOnPage} from "../app/renderer/container.ts";
+import {type AtlasEntry, planAtlas} from "../app/renderer/atlas.ts";
 
 let json = `
         {
@@ -206,6 +208,138 @@ describe('testing mockRenderer', () => {
     });
 });
 
+describe('testing pageGeometry', () => {
+    test('A4 portrait with explicit margins', () => {
+        let geometry = pageGeometry(page);
+        expect(geometry.width).toBeCloseTo(595.28, 1);
+        expect(geometry.height).toBeCloseTo(841.89, 1);
+        expect(geometry.margins).toStrictEqual([36.0, 36.0, 36.0, 36.0]);
+    });
+
+    test('landscape swaps width and height', () => {
+        let geometry = pageGeometry({...page, orientation: 'landscape', margins: 10});
+        expect(geometry.width).toBeGreaterThan(geometry.height);
+        expect(geometry.margins).toStrictEqual([10, 10, 10, 10]);
+    });
+
+    test('maps are shrunk to fit inside the margins', () => {
+        let geometry = pageGeometry(page);
+        let placement = placeOnPage(geometry, [5100, 2650], 72.0, 'L-Ec-01');
+        expect(placement.x).toBeGreaterThanOrEqual(36.0);
+        expect(placement.x + placement.width).toBeLessThanOrEqual(geometry.width - 36.0 + 1e-6);
+        expect(placement.width / placement.height).toBeCloseTo(5100 / 2650);
+        expect(placement.caption?.text).toBe('L-Ec-01');
+    });
+
+    test('the page ppi sets the natural size of the map', () => {
+        let geometry = pageGeometry({...page, ppi: 144});
+        expect(geometry.ppi).toBe(144);
+        let placement = placeOnPage(geometry, [200, 100], 300, undefined);
+        expect(placement.width).toBeCloseTo(100);
+        expect(placement.height).toBeCloseTo(50);
+        expect(placeOnPage(pageGeometry({...page, ppi: undefined}), [200, 100], 300, undefined).width).toBeCloseTo(48);
+    });
+});
+
+describe('testing derivativeSizes', () => {
+    test('scales and fixed widths keep the aspect ratio', () => {
+        let sizes = derivativeSizes([5100, 2650], [
+            {scale: 0.5, width: undefined},
+            {scale: 0.25, width: undefined},
+            {scale: undefined, width: 320}
+        ]);
+        expect(sizes).toStrictEqual([[2550, 1325], [1275, 663], [320, 166]]);
+    });
+
+    test('upscaling, duplicates and empty entries are ignored', () => {
+        let sizes = derivativeSizes([100, 100], [
+            {scale: 2, width: undefined},
+            {scale: undefined, width: 100},
+            {scale: 0.5, width: undefined},
+            {scale: undefined, width: 50},
+            {scale: undefined, width: undefined}
+        ]);
+        expect(sizes).toStrictEqual([[50, 50]]);
+        expect(derivativeSizes([100, 100], undefined)).toStrictEqual([]);
+    });
+});
+
+describe('testing withDatasourceParameters', () => {
+    const xml = `<Map>
+<Layer name="roads"><Datasource>
+    <Parameter name="type"><![CDATA[postgis]]></Parameter>
+    <Parameter name="max_size"><![CDATA[20]]></Parameter>
+</Datasource></Layer>
+<Layer name="water"><Datasource>
+    <Parameter name="type">postgis</Parameter>
+</Datasource></Layer>
+<Layer name="coast"><Datasource>
+    <Parameter name="type">shape</Parameter>
+</Datasource></Layer>
+</Map>`;
+
+    test('only datasources of the given type are changed', () => {
+        const result = withDatasourceParameters(xml, 'postgis', {max_async_connection: 4});
+        expect(result.match(/<Parameter name="max_async_connection">4<\/Parameter>/g)?.length).toBe(2);
+        expect(result).toContain('<Layer name="coast"><Datasource>\n    <Parameter name="type">shape</Parameter>\n</Datasource>');
+    });
+
+    test('existing parameters are replaced and can be derived from', () => {
+        const result = withDatasourceParameters(xml, 'postgis', {max_size: current => Math.max(Number(current ?? 10), 16)});
+        expect(result).not.toContain('<![CDATA[20]]>');
+        expect(result.match(/<Parameter name="max_size">(\d+)<\/Parameter>/g)).toStrictEqual([
+            '<Parameter name="max_size">20</Parameter>',
+            '<Parameter name="max_size">16</Parameter>'
+        ]);
+    });
+
+    test('datasources based on a template take its type and values', () => {
+        const templated = `<Map>
+<Datasource name="osm">
+    <Parameter name="type">postgis</Parameter>
+    <Parameter name="max_size">30</Parameter>
+</Datasource>
+<Layer name="roads"><Datasource base="osm">
+    <Parameter name="table">planet_osm_line</Parameter>
+</Datasource></Layer>
+<Layer name="coast"><Datasource>
+    <Parameter name="type">shape</Parameter>
+</Datasource></Layer>
+</Map>`;
+        const result = withDatasourceParameters(templated, 'postgis', {max_size: current => Math.max(Number(current ?? 10), 16)});
+        expect(result).toContain('<Layer name="roads"><Datasource base="osm">\n    <Parameter name="table">planet_osm_line</Parameter>\n<Parameter name="max_size">30</Parameter>\n</Datasource>');
+        expect(result.match(/<Parameter name="max_size">30<\/Parameter>/g)?.length).toBe(2);
+        expect(result).toContain('<Layer name="coast"><Datasource>\n    <Parameter name="type">shape</Parameter>\n</Datasource>');
+    });
+});
+
+describe('testing planAtlas', () => {
+    // 10 map units per pixel
+    function entry(x: number, y: number, width: number, height: number, scale: number = 10): AtlasEntry {
+        return {extent: [x, y, x + width * scale, y + height * scale], size: [width, height]};
+    }
+
+    test('overlapping maps at the same scale share one canvas', () => {
+        let groups = planAtlas([entry(0, 0, 100, 100), entry(500, 0, 100, 100), entry(0, 500, 100, 100), entry(0, 0, 100, 100, 20)], 1e9);
+        expect(groups.length).toBe(1);
+        expect(groups[0]!.size).toStrictEqual([150, 150]);
+        expect(groups[0]!.extent).toStrictEqual([0, 0, 1500, 1500]);
+        expect(groups[0]!.members).toStrictEqual([{index: 0, x: 0, y: 50}, {index: 1, x: 50, y: 50}, {index: 2, x: 0, y: 0}]);
+    });
+
+    test('distant maps and oversized canvases are rendered separately', () => {
+        expect(planAtlas([entry(0, 0, 100, 100), entry(5000, 0, 100, 100)], 1e9)).toStrictEqual([]);
+        expect(planAtlas([entry(0, 0, 100, 100), entry(500, 0, 100, 100)], 1000)).toStrictEqual([]);
+    });
+
+    test('separate clusters at the same scale get their own canvas', () => {
+        let groups = planAtlas([entry(0, 0, 100, 100), entry(100000, 0, 100, 100), entry(500, 0, 100, 100), entry(100500, 0, 100, 100), entry(50000, 0, 100, 100)], 1e9);
+        expect(groups.map(group => group.members.map(member => member.index))).toStrictEqual([[0, 2], [1, 3]]);
+        expect(groups[0]!.extent).toStrictEqual([0, 0, 1500, 1000]);
+        expect(groups[1]!.size).toStrictEqual([150, 100]);
+    });
+});
+
 /* describe('testing buildPdf', () => {
     test('empty string should result in zero', async () => {
         let images: Array<Territorium.ResultBuffer> = [];
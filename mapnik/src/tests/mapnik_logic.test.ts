@@ -15,7 +15,9 @@
  */
 
 import {Mapnik} from "../app/renderer/mapnik.ts";
+import {defaultMemoryEstimate} from "../app/scheduler.ts";
 import {describe, expect, test} from "bun:test";
+import sharp from "sharp";
 
 describe("Mapnik Core Logic & Metadata", () => {
     const mapnik = new Mapnik();
@@ -67,6 +69,118 @@ describe("In-Memory Rendering & Encoding", () => {
         expect(buffer![2]).toBe(0x4E); // 'N'
     });
 
+    test("image resize should return a smaller image", () => {
+        using im = mapnik.Image(40, 20);
+        using small = im.resize(10, 5);
+        expect(small.width).toBe(10);
+        expect(small.height).toBe(5);
+        expect(small.encode("png")![0]).toBe(0x89);
+        expect(() => im.resize(80, 40)).toThrow();
+    });
+
+    test("image crop should copy a rectangle", () => {
+        using im = mapnik.Image(40, 20);
+        using part = im.crop(10, 5, 20, 10);
+        expect(part.width).toBe(20);
+        expect(part.height).toBe(10);
+        expect(() => im.crop(30, 0, 20, 10)).toThrow();
+    });
+
+    test("tiled rendering should fill an image larger than a tile", () => {
+        using map = mapnik.Map(300, 200);
+        map.loadString('<Map background-color="#ff0000"></Map>');
+        map.zoomToBox([0, 0, 3000, 2000]);
+        using im = mapnik.Image(300, 200);
+        map.renderTiled(im, 128);
+        expect(map.width).toBe(300);
+        expect(map.extent[2]).toBeCloseTo(3000);
+        expect(im.encode("png")![0]).toBe(0x89);
+    });
+
+    test("tiled rendering places markers once over the whole map", () => {
+        const merc = "+proj=merc +a=6378137 +b=6378137 +lat_ts=0.0 +lon_0=0.0 +x_0=0.0 +y_0=0 +k=1.0 +units=m +nadgrids=@null +no_defs +over";
+        // 10 units per pixel: the markers of a (x=100) and b (x=140) collide, only one is placed.
+        // A tile starting at x=128 does not see a and would place b on its own.
+        const geojson = JSON.stringify({
+            type: "FeatureCollection",
+            features: [
+                {type: "Feature", properties: {name: "a"}, geometry: {type: "Point", coordinates: [1000, 1000]}},
+                {type: "Feature", properties: {name: "b"}, geometry: {type: "Point", coordinates: [1400, 1000]}}
+            ]
+        });
+        const render = (withMarkers: boolean) => {
+            using map = mapnik.Map(300, 200);
+            map.loadString(`<Map srs="${merc}" background-color="#ff0000">
+                <Style name="markers"><Rule><MarkersSymbolizer width="60" height="60" fill="#0000ff" stroke-width="0"/></Rule></Style>
+            </Map>`);
+            if (withMarkers) {
+                using layer = mapnik.Layer("points", merc);
+                layer.setDatasource(mapnik.Datasource.geojsonInline(geojson));
+                layer.addStyle("markers");
+                map.addLayer(layer);
+            }
+            map.zoomToBox([0, 0, 3000, 2000]);
+            const im = mapnik.Image(300, 200);
+            map.renderTiled(im, 128);
+            return im;
+        };
+
+        using background = render(false);
+        using tiled = render(true);
+        const drawn = [95, 135].filter(x => {
+            using marker = tiled.crop(x, 95, 10, 10);
+            using empty = background.crop(x, 95, 10, 10);
+            return !marker.encode("png")!.equals(empty.encode("png")!);
+        });
+        expect(drawn.length).toBe(1);
+    });
+
+    test("tiled rendering matches an untiled render", async () => {
+        const merc = "+proj=merc +a=6378137 +b=6378137 +lat_ts=0.0 +lon_0=0.0 +x_0=0.0 +y_0=0 +k=1.0 +units=m +nadgrids=@null +no_defs +over";
+        // Markers next to tile edges, a line crossing them and a polygon layer above the markers.
+        const points = JSON.stringify({
+            type: "FeatureCollection",
+            features: [[1000, 1000], [1400, 1000], [2500, 1300], [2700, 500]].map(([x, y]) => (
+                {type: "Feature", properties: {}, geometry: {type: "Point", coordinates: [x, y]}}))
+        });
+        const shapes = JSON.stringify({
+            type: "FeatureCollection",
+            features: [
+                {type: "Feature", properties: {}, geometry: {type: "LineString", coordinates: [[100, 100], [2900, 1900]]}},
+                {type: "Feature", properties: {}, geometry: {type: "Polygon", coordinates: [[[2300, 1100], [2800, 1100], [2800, 1500], [2300, 1500], [2300, 1100]]]}}
+            ]
+        });
+        const render = async (tiled: boolean) => {
+            using map = mapnik.Map(300, 200);
+            map.loadString(`<Map srs="${merc}" background-color="#ff0000">
+                <Style name="markers"><Rule><MarkersSymbolizer width="60" height="60" fill="#0000ff" stroke-width="0"/></Rule></Style>
+                <Style name="shapes"><Rule><LineSymbolizer stroke="#00ff00" stroke-width="5"/><PolygonSymbolizer fill="#ffff00"/></Rule></Style>
+            </Map>`);
+            for (const [name, style, geojson] of [["points", "markers", points], ["shapes", "shapes", shapes]]) {
+                using layer = mapnik.Layer(name!, merc);
+                layer.setDatasource(mapnik.Datasource.geojsonInline(geojson!));
+                layer.addStyle(style!);
+                map.addLayer(layer);
+            }
+            map.zoomToBox([0, 0, 3000, 2000]);
+            using im = mapnik.Image(300, 200);
+            if (tiled)
+                map.renderTiled(im, 128);
+            else
+                map.render(im);
+            return await sharp(im.encode("png")!).raw().toBuffer();
+        };
+
+        const untiled = await render(false);
+        const tiled = await render(true);
+        expect(tiled.length).toBe(untiled.length);
+        let differing = 0;
+        for (let i = 0; i < tiled.length; i++)
+            if (Math.abs(tiled[i]! - untiled[i]!) > 2)
+                differing++;
+        expect(differing).toBeLessThan(tiled.length / 1000);
+    });
+
     test("SVG string rendering should return XML markup", () => {
         if (!mapnik.supports.cairo) {
             console.warn("Skipping SVG test: Cairo not supported");
@@ -98,6 +212,290 @@ describe("Fonts & Resources", () => {
         expect(cache).toHaveProperty("count");
         expect(typeof cache.count).toBe("number");
     });
+
+    test("prewarming should count unknown faces as failed", () => {
+        const before = mapnik.fontCacheInfo.prewarm_failed;
+        expect(mapnik.prewarmFonts(["No Such Face Regular"])).toBe(0);
+        expect(mapnik.fontCacheInfo.prewarm_failed).toBe(before + 1);
+
+        const faces = mapnik.fontFaces;
+        if (faces.length > 0) {
+            expect(mapnik.prewarmFonts([faces[0]!])).toBe(1);
+            expect(mapnik.prewarmFonts([faces[0]!])).toBe(1);
+            expect(mapnik.fontCacheInfo.prewarm_reused).toBeGreaterThan(0);
+        }
+    });
+});
+
+describe("Memory Estimate", () => {
+    const mapnik = new Mapnik();
+
+    test("the scheduler fallback matches the native estimate", () => {
+        for (const [width, height] of [[0, 100], [1, 1], [510, 265], [9933, 14043]]) {
+            for (const vector of [false, true])
+                expect(defaultMemoryEstimate(width!, height!, vector)).toBe(mapnik.renderMemoryEstimate(width!, height!, vector));
+        }
+    });
+});
+
+describe("Feature Cache", () => {
+    const mapnik = new Mapnik();
+
+    test("stats should reflect the configured budget", () => {
+        mapnik.configureFeatureCache(1024 * 1024);
+        const stats = mapnik.featureCacheStats;
+        expect(stats.budget).toBe(1024 * 1024);
+        expect(typeof stats.hits).toBe("number");
+        expect(typeof stats.misses).toBe("number");
+        mapnik.clearFeatureCache();
+        expect(mapnik.featureCacheStats.entries).toBe(0);
+    });
+
+    test("enableFeatureCache on a map without PostGIS layers wraps nothing", () => {
+        using map = mapnik.Map(100, 100);
+        map.loadString("<Map></Map>");
+        expect(map.enableFeatureCache()).toBe(0);
+    });
+
+    test("repeated queries hit, other scale bands and property sets miss", () => {
+        const geojson = JSON.stringify({
+            type: "FeatureCollection",
+            features: [{type: "Feature", properties: {name: "road"}, geometry: {type: "LineString", coordinates: [[0, 0], [10, 10]]}}]
+        });
+        const lines = `<Map srs="+proj=longlat +datum=WGS84 +no_defs">
+            <Style name="lines"><Rule><LineSymbolizer stroke="#000"/></Rule></Style>
+            <Style name="named"><Rule><Filter>[name] = 'road'</Filter><LineSymbolizer stroke="#000"/></Rule></Style>
+        </Map>`;
+        const render = (styleName: string, bbox: [number, number, number, number]) => {
+            using map = mapnik.Map(100, 100);
+            map.loadString(lines);
+            using layer = mapnik.Layer("roads", "+proj=longlat +datum=WGS84 +no_defs");
+            layer.setDatasource(mapnik.Datasource.geojsonInline(geojson));
+            layer.addStyle(styleName);
+            map.addLayer(layer);
+            expect(map.enableFeatureCache(["geojson"])).toBe(1);
+            map.zoomToBox(bbox);
+            using image = mapnik.Image(100, 100);
+            map.render(image);
+        };
+
+        mapnik.configureFeatureCache(16 * 1024 * 1024, 3600);
+        mapnik.clearFeatureCache();
+        const before = mapnik.featureCacheStats;
+        render("lines", [0, 0, 10, 10]);
+        render("lines", [0, 0, 10, 10]);
+        let stats = mapnik.featureCacheStats;
+        expect(stats.misses - before.misses).toBe(1);
+        expect(stats.hits - before.hits).toBe(1);
+        expect(stats.entries).toBe(1);
+
+        render("lines", [2, 2, 6, 6]);
+        expect(mapnik.featureCacheStats.misses - stats.misses).toBe(1);
+        stats = mapnik.featureCacheStats;
+        render("named", [0, 0, 10, 10]);
+        expect(mapnik.featureCacheStats.misses - stats.misses).toBe(1);
+        expect(mapnik.featureCacheStats.ttl).toBe(3600);
+        mapnik.configureFeatureCache(1024 * 1024);
+        mapnik.clearFeatureCache();
+    });
+});
+
+describe("Projection Cache", () => {
+    const mapnik = new Mapnik();
+    const merc = "+proj=merc +a=6378137 +b=6378137 +lat_ts=0.0 +lon_0=0.0 +x_0=0.0 +y_0=0 +k=1.0 +units=m +nadgrids=@null +no_defs +over";
+    const geojson = JSON.stringify({
+        type: "FeatureCollection",
+        features: [{type: "Feature", properties: {name: "a"}, geometry: {type: "Point", coordinates: [10, 50]}}]
+    });
+
+    test("map srs is readable", () => {
+        using map = mapnik.Map(10, 10);
+        map.loadString(`<Map srs="${merc}"></Map>`);
+        expect(map.srs).toBe(merc);
+    });
+
+    test("transforms are cached per source and target", () => {
+        using raw = mapnik.Datasource.geojsonInline(geojson);
+        const before = mapnik.projCacheStats;
+        using first = mapnik.Datasource.projected(raw, "epsg:4326", merc);
+        using second = mapnik.Datasource.projected(raw, "epsg:4326", merc);
+        const after = mapnik.projCacheStats;
+        expect(after.hits).toBeGreaterThan(before.hits);
+        expect(after.entries).toBeGreaterThanOrEqual(1);
+
+        // lon 10, lat 50 in web mercator; projecting again must not see already projected input
+        for (const projected of [first, second]) {
+            const [minx, miny, maxx, maxy] = projected.extent;
+            expect(minx).toBeCloseTo(1113194.91, 1);
+            expect(miny).toBeCloseTo(6446275.84, 1);
+            expect(maxx).toBeCloseTo(minx, 6);
+            expect(maxy).toBeCloseTo(miny, 6);
+        }
+        expect(raw.extent).toStrictEqual([10, 50, 10, 50]);
+    });
+
+    test("equivalent definitions are recognised as identity", () => {
+        using raw = mapnik.Datasource.geojsonInline(geojson);
+        using same = mapnik.Datasource.projected(raw, merc, merc);
+        expect(mapnik.projCacheStats.identity).toBeGreaterThanOrEqual(1);
+    });
+});
+
+describe("Vector Tiles", () => {
+    const mapnik = new Mapnik();
+    const merc = "+proj=merc +a=6378137 +b=6378137 +lat_ts=0.0 +lon_0=0.0 +x_0=0.0 +y_0=0 +k=1.0 +units=m +nadgrids=@null +no_defs +over";
+    const geojson = JSON.stringify({
+        type: "FeatureCollection",
+        features: [{
+            type: "Feature",
+            properties: {name: "territory"},
+            geometry: {type: "Polygon", coordinates: [[[-1e6, -1e6], [1e6, -1e6], [1e6, 1e6], [-1e6, 1e6], [-1e6, -1e6]]]}
+        }]
+    });
+
+    test("overlay layers are encoded as a tile", () => {
+        using map = mapnik.Map(256, 256);
+        map.loadString(`<Map srs="${merc}"></Map>`);
+        using layer = mapnik.Layer("border0", merc);
+        layer.setDatasource(mapnik.Datasource.geojsonInline(geojson));
+        map.addLayer(layer);
+
+        const tile = map.renderMvt(0, 0, 0, ["border0"]);
+        expect(tile.length).toBeGreaterThan(0);
+        expect(tile[0]).toBe(0x1a); // Tile.layers, length delimited
+        expect(tile.includes(Buffer.from("territory"))).toBe(true);
+
+        expect(map.renderMvt(0, 0, 0, ["missing"]).length).toBe(0);
+        expect(() => map.renderMvt(1, 2, 0)).toThrow();
+    });
+});
+
+describe("Preview Profile", () => {
+    const mapnik = new Mapnik();
+    const geojson = JSON.stringify({
+        type: "FeatureCollection",
+        features: [{type: "Feature", properties: {name: "road"}, geometry: {type: "LineString", coordinates: [[0, 0], [10, 10]]}}]
+    });
+    const style = `<Map srs="+proj=longlat +datum=WGS84 +no_defs">
+        <Style name="lines"><Rule><LineSymbolizer stroke="#000" smooth="0.5"/></Rule></Style>
+        <Style name="labels"><Rule><TextSymbolizer face-name="DejaVu Sans Book" size="10">[name]</TextSymbolizer></Rule></Style>
+    </Map>`;
+
+    test("label-only and listed layers are removed", () => {
+        using map = mapnik.Map(100, 100);
+        map.loadString(style);
+        for (const [name, styleName] of [["roads", "lines"], ["names", "labels"], ["trees", "lines"]]) {
+            using layer = mapnik.Layer(name!, "+proj=longlat +datum=WGS84 +no_defs");
+            layer.setDatasource(mapnik.Datasource.geojsonInline(geojson));
+            layer.addStyle(styleName!);
+            map.addLayer(layer);
+        }
+
+        expect(map.derivePreview(1.5, ["trees"])).toBe(2);
+        expect(map.derivePreview()).toBe(0);
+
+        map.zoomAll();
+        using image = mapnik.Image(100, 100);
+        expect(() => map.render(image)).not.toThrow();
+    });
+
+    test("only lines and polygons are simplified, emptied rules are removed", () => {
+        using map = mapnik.Map(100, 100);
+        map.loadString(`<Map srs="+proj=longlat +datum=WGS84 +no_defs">
+            <Style name="mixed">
+                <Rule><Filter>[name] = 'road'</Filter><LineSymbolizer stroke="#000"/><MarkersSymbolizer width="4"/></Rule>
+                <Rule><Filter>[name] = 'label'</Filter><TextSymbolizer face-name="DejaVu Sans Book" size="10">[name]</TextSymbolizer></Rule>
+            </Style>
+            <Style name="fallback">
+                <Rule><Filter>[name] = 'label'</Filter><TextSymbolizer face-name="DejaVu Sans Book" size="10">[name]</TextSymbolizer></Rule>
+                <Rule><ElseFilter/><PolygonSymbolizer fill="#ccc"/></Rule>
+            </Style>
+        </Map>`);
+        using layer = mapnik.Layer("roads", "+proj=longlat +datum=WGS84 +no_defs");
+        layer.setDatasource(mapnik.Datasource.geojsonInline(geojson));
+        layer.addStyle("mixed");
+        layer.addStyle("fallback");
+        map.addLayer(layer);
+
+        expect(map.derivePreview(1.5)).toBe(0);
+        const xml = map.toXml();
+        const mixed = xml.slice(xml.indexOf('<Style name="mixed"'), xml.indexOf("</Style>", xml.indexOf('<Style name="mixed"')));
+        const fallback = xml.slice(xml.indexOf('<Style name="fallback"'), xml.indexOf("</Style>", xml.indexOf('<Style name="fallback"')));
+        expect(mixed.match(/<Rule/g)?.length).toBe(1);
+        expect(mixed).toMatch(/<LineSymbolizer[^>]*simplify="1.5"/);
+        expect(mixed).not.toMatch(/<MarkersSymbolizer[^>]*simplify=/);
+        // The emptied rule still keeps its features away from the else-rule.
+        expect(fallback.match(/<Rule/g)?.length).toBe(2);
+        expect(fallback).toMatch(/<PolygonSymbolizer[^>]*simplify="1.5"/);
+    });
+
+    test("emptied rules still hiding later rules in filter-mode first are kept", () => {
+        using map = mapnik.Map(100, 100);
+        map.loadString(`<Map srs="+proj=longlat +datum=WGS84 +no_defs">
+            <Style name="first" filter-mode="first">
+                <Rule><Filter>[name] = 'label'</Filter><TextSymbolizer face-name="DejaVu Sans Book" size="10">[name]</TextSymbolizer></Rule>
+                <Rule><PolygonSymbolizer fill="#ccc"/></Rule>
+                <Rule><Filter>[name] = 'other'</Filter><TextSymbolizer face-name="DejaVu Sans Book" size="10">[name]</TextSymbolizer></Rule>
+            </Style>
+        </Map>`);
+        using layer = mapnik.Layer("areas", "+proj=longlat +datum=WGS84 +no_defs");
+        layer.setDatasource(mapnik.Datasource.geojsonInline(geojson));
+        layer.addStyle("first");
+        map.addLayer(layer);
+
+        expect(map.derivePreview(0)).toBe(0);
+        const xml = map.toXml();
+        const first = xml.slice(xml.indexOf('<Style name="first"'), xml.indexOf("</Style>", xml.indexOf('<Style name="first"')));
+        // The emptied label rule keeps labels from being drawn as polygons; the trailing one hides nothing.
+        const rules = first.match(/<Rule>[\s\S]*?<\/Rule>/g) ?? [];
+        expect(rules.length).toBe(2);
+        expect(rules[0]).toContain("label");
+        expect(rules[1]).toContain("<PolygonSymbolizer");
+    });
+});
+
+describe("Preloaded File Datasources", () => {
+    const mapnik = new Mapnik();
+
+    test("a map without file datasources lists and preloads nothing", () => {
+        using map = mapnik.Map(100, 100);
+        map.loadString("<Map></Map>");
+        expect(map.fileDatasources).toStrictEqual([]);
+        expect(map.preloadFileDatasources()).toBe(0);
+        expect(map.usePreloadedDatasources()).toBe(0);
+    });
+
+    test("claimFile succeeds only once per file", () => {
+        const file = `/tmp/claim-${Date.now()}.shp`;
+        expect(mapnik.claimFile(file)).toBe(true);
+        expect(mapnik.claimFile(file)).toBe(false);
+        mapnik.releaseFile(file);
+        expect(mapnik.claimFile(file)).toBe(false);
+    });
+
+    test("waitForFiles returns once claims are released", () => {
+        const file = `/tmp/wait-${Date.now()}.shp`;
+        expect(mapnik.waitForFiles([file])).toBe(true);
+        expect(mapnik.claimFile(file)).toBe(true);
+        mapnik.releaseFile(file);
+        expect(mapnik.waitForFiles([file, "/tmp/never-claimed.shp"])).toBe(true);
+    });
+
+    test("clones share the loaded style at another size", () => {
+        using map = mapnik.Map(100, 100);
+        map.loadString(`<Map srs="+proj=longlat +datum=WGS84 +no_defs"><Style name="lines"><Rule><LineSymbolizer/></Rule></Style></Map>`);
+        using clone = map.clone(300, 200);
+        expect(clone.width).toBe(300);
+        expect(clone.height).toBe(200);
+        expect(clone.srs).toBe(map.srs);
+        expect(map.width).toBe(100);
+    });
+
+    test("stats report an index hit rate", () => {
+        const stats = mapnik.fileDatasourceStats;
+        expect(typeof stats.indexed_query_share).toBe("number");
+        expect(Array.isArray(stats.files)).toBe(true);
+    });
 });
 
 describe("Error Handling", () => {
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2019-2025 Simon Zigelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+import {defaultMemoryEstimate, estimateJobCost, type JobCost, JobScheduler} from "../app/scheduler.ts";
+import {describe, expect, test} from "bun:test";
+
+function job(sizes: Array<[number, number]>, mediaType: string = 'image/png'): string {
+    return JSON.stringify({
+        job: 'test',
+        payload: {polygon: sizes.map(size => ({size: size, mediaType: mediaType})), page: undefined}
+    });
+}
+
+function deferred() {
+    let resolve: (value: string) => void = () => undefined;
+    const promise = new Promise<string>(r => resolve = r);
+    return {promise, resolve};
+}
+
+describe('testing estimateJobCost', () => {
+    test('small single polygon is interactive', () => {
+        const cost = estimateJobCost(job([[510, 265]]), defaultMemoryEstimate, 4 * 1024 * 1024);
+        expect(cost.lane).toBe('interactive');
+        expect(cost.pixels).toBe(510 * 265);
+        expect(cost.memory).toBeGreaterThan(510 * 265 * 4);
+    });
+
+    test('poster and multi polygon jobs are bulk', () => {
+        expect(estimateJobCost(job([[9933, 14043]]), defaultMemoryEstimate, 4 * 1024 * 1024).lane).toBe('bulk');
+        expect(estimateJobCost(job([[100, 100], [100, 100]]), defaultMemoryEstimate, 4 * 1024 * 1024).lane).toBe('bulk');
+    });
+
+    test('invalid JSON costs nothing', () => {
+        const cost = estimateJobCost('{', defaultMemoryEstimate, 1);
+        expect(cost.pixels).toBe(0);
+        expect(cost.lane).toBe('interactive');
+    });
+});
+
+describe('testing JobScheduler', () => {
+    const small: JobCost = {pixels: 10, memory: 10, polygons: 1, lane: 'interactive'};
+    const big: JobCost = {pixels: 100, memory: 100, polygons: 4, lane: 'bulk'};
+
+    test('budget limits concurrent jobs but oversized jobs still run alone', async () => {
+        const scheduler = new JobScheduler<string>({maxConcurrent: 4, maxPixels: 50, maxMemory: 1000});
+        const first = deferred();
+        const a = scheduler.schedule(big, () => first.promise);
+        const b = scheduler.schedule(small, async () => 'small');
+        expect(scheduler.stats.running).toBe(1);
+        first.resolve('big');
+        expect(await a).toBe('big');
+        expect(await b).toBe('small');
+        expect(scheduler.stats.running).toBe(0);
+    });
+
+    test('interactive jobs overtake queued bulk jobs', async () => {
+        const scheduler = new JobScheduler<string>({maxConcurrent: 1, maxPixels: 1000, maxMemory: 1000});
+        const order: string[] = [];
+        const blocker = deferred();
+        const running = scheduler.schedule(small, () => blocker.promise);
+        const bulk = scheduler.schedule(big, async () => { order.push('bulk'); return 'bulk'; });
+        const interactive = scheduler.schedule(small, async () => { order.push('interactive'); return 'interactive'; });
+        blocker.resolve('done');
+        await Promise.all([running, bulk, interactive]);
+        expect(order).toStrictEqual(['interactive', 'bulk']);
+    });
+});
@@ -56,6 +56,32 @@ extern "C" {
         return (*ds) ? 1 : 0;
     }
 
+    EXPORT int32_t datasource_get_extent(void *ds_ptr, double *out4) {
+        if (!ds_ptr || !out4) {
+            _set_last_error("datasource_get_extent: null datasource or out4");
+            return 0;
+        }
+        try {
+            auto const &ds = *static_cast<mapnik::datasource_ptr *>(ds_ptr);
+            if (!ds) {
+                _set_last_error("datasource_get_extent: invalid datasource");
+                return 0;
+            }
+            mapnik::box2d<double> b = ds->envelope();
+            out4[0] = b.minx();
+            out4[1] = b.miny();
+            out4[2] = b.maxx();
+            out4[3] = b.maxy();
+            return 1;
+        } catch (std::exception const &ex) {
+            _set_last_error(ex.what());
+            return 0;
+        } catch (...) {
+            _set_last_error("datasource_get_extent: unknown error");
+            return 0;
+        }
+    }
+
     static void *_create_ds_from_params(mapnik::parameters const &params) {
         try {
             mapnik::datasource_ptr ds = mapnik::datasource_cache::instance().create(params);
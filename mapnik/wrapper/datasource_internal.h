@@ -0,0 +1,131 @@
+/*
+ * Copyright 2019-2025 Simon Zigelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <mapnik/datasource.hpp>
+#include <mapnik/feature.hpp>
+#include <mapnik/featureset.hpp>
+#include <mapnik/query.hpp>
+#include <mapnik/geometry.hpp>
+#include <mapnik/util/variant.hpp>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+// -----------------------------
+// Shared datasource helpers (C++ only, not exported)
+// -----------------------------
+
+namespace wrapper {
+    using feature_vector = std::vector<mapnik::feature_ptr>;
+    using feature_vector_ptr = std::shared_ptr<const feature_vector>;
+
+    // Serves already materialized features, filtered by bbox. Holds a reference to the
+    // vector so cache eviction while a render iterates stays safe.
+    class vector_featureset : public mapnik::Featureset {
+    public:
+        vector_featureset(feature_vector_ptr features, mapnik::box2d<double> const &bbox)
+            : features_(std::move(features)), bbox_(bbox) {}
+
+        mapnik::feature_ptr next() override {
+            while (pos_ < features_->size()) {
+                mapnik::feature_ptr const &feature = (*features_)[pos_++];
+                if (feature && feature->envelope().intersects(bbox_)) return feature;
+            }
+            return mapnik::feature_ptr();
+        }
+
+    private:
+        feature_vector_ptr features_;
+        mapnik::box2d<double> bbox_;
+        std::size_t pos_ = 0;
+    };
+
+    // Base for datasources that wrap another one (cache, prefetch, ...).
+    // get_context/features_with_context are not forwarded by default, so Mapnik
+    // always ends up in our features() override; wrappers that understand
+    // processor contexts (PostGIS asynchronous requests) override both.
+    class forwarding_datasource : public mapnik::datasource {
+    public:
+        using geometry_type_result = decltype(std::declval<mapnik::datasource const &>().get_geometry_type());
+
+        explicit forwarding_datasource(mapnik::datasource_ptr inner)
+            : mapnik::datasource(inner->params()), inner_(std::move(inner)) {}
+
+        mapnik::datasource::datasource_t type() const override { return inner_->type(); }
+
+        mapnik::featureset_ptr features(mapnik::query const &q) const override { return inner_->features(q); }
+
+        mapnik::featureset_ptr features_at_point(mapnik::coord2d const &pt, double tol) const override {
+            return inner_->features_at_point(pt, tol);
+        }
+
+        mapnik::box2d<double> envelope() const override { return inner_->envelope(); }
+
+        geometry_type_result get_geometry_type() const override { return inner_->get_geometry_type(); }
+
+        mapnik::layer_descriptor get_descriptor() const override { return inner_->get_descriptor(); }
+
+        mapnik::datasource_ptr const &inner() const { return inner_; }
+
+    protected:
+        mapnik::datasource_ptr inner_;
+    };
+
+    struct vertex_counter {
+        std::size_t operator()(mapnik::geometry::geometry_empty const &) const { return 0; }
+
+        std::size_t operator()(mapnik::geometry::point<double> const &) const { return 1; }
+
+        std::size_t operator()(mapnik::geometry::line_string<double> const &line) const { return line.size(); }
+
+        std::size_t operator()(mapnik::geometry::polygon<double> const &poly) const {
+            std::size_t n = 0;
+            for (auto const &ring: poly) n += ring.size();
+            return n;
+        }
+
+        std::size_t operator()(mapnik::geometry::multi_point<double> const &points) const { return points.size(); }
+
+        std::size_t operator()(mapnik::geometry::multi_line_string<double> const &lines) const {
+            std::size_t n = 0;
+            for (auto const &line: lines) n += line.size();
+            return n;
+        }
+
+        std::size_t operator()(mapnik::geometry::multi_polygon<double> const &polys) const {
+            std::size_t n = 0;
+            for (auto const &poly: polys) n += (*this)(poly);
+            return n;
+        }
+
+        std::size_t operator()(mapnik::geometry::geometry_collection<double> const &collection) const {
+            std::size_t n = 0;
+            for (auto const &geom: collection) n += mapnik::util::apply_visitor(*this, geom);
+            return n;
+        }
+    };
+
+    // Rough heap footprint of a feature; good enough for budget accounting.
+    inline std::size_t estimate_feature_bytes(mapnik::feature_impl const &feature) {
+        std::size_t const vertices = mapnik::util::apply_visitor(vertex_counter(), feature.get_geometry());
+        return sizeof(mapnik::feature_impl)
+               + vertices * sizeof(mapnik::geometry::point<double>)
+               + feature.size() * 64;
+    }
+}
@@ -0,0 +1,339 @@
+/*
+ * Copyright 2019-2025 Simon Zigelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "include/mapnik.h"
+#include "mapnik_internal.h"
+#include "datasource_internal.h"
+
+#include <mapnik/map.hpp>
+#include <mapnik/layer.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <list>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+// -----------------------------
+// Feature cache
+// Process-wide LRU for PostGIS features, shared by all worker threads.
+// Entries are keyed by layer, scale band, property names and query variables and
+// cover a bbox snapped to a grid, so overlapping requests are answered from memory.
+// Entries expire after a configurable TTL, so a re-imported database is picked
+// up without restarting the workers; feature_cache_clear flushes at once.
+// -----------------------------
+
+namespace {
+    // Grid cell edge in pixels at the query resolution. Query boxes are snapped
+    // outwards to this grid, which also defines how far an entry over-fetches.
+    constexpr double kCellPixels = 512.0;
+
+    // Entries larger than budget / kMaxEntryShare are not cached.
+    constexpr std::size_t kMaxEntryShare = 4;
+
+    using cache_clock = std::chrono::steady_clock;
+
+    struct cache_entry {
+        std::string prefix;
+        mapnik::box2d<double> bbox;
+        wrapper::feature_vector_ptr features;
+        std::size_t bytes;
+        cache_clock::time_point expires;
+    };
+
+    class feature_cache {
+    public:
+        static feature_cache &instance() {
+            static feature_cache cache;
+            return cache;
+        }
+
+        std::size_t budget() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return budget_;
+        }
+
+        // ttl of zero keeps entries until they are evicted or cleared.
+        void configure(std::size_t budget, std::chrono::seconds ttl) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            budget_ = budget;
+            ttl_ = ttl;
+            evict_locked();
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            lru_.clear();
+            index_.clear();
+            used_ = 0;
+        }
+
+        wrapper::feature_vector_ptr lookup(std::string const &prefix, mapnik::box2d<double> const &bbox) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto const now = cache_clock::now();
+            auto range = index_.equal_range(prefix);
+            for (auto it = range.first; it != range.second;) {
+                auto entry = it->second;
+                if (entry->expires <= now) {
+                    used_ -= entry->bytes;
+                    lru_.erase(entry);
+                    it = index_.erase(it);
+                    ++expired_;
+                    continue;
+                }
+                if (entry->bbox.contains(bbox)) {
+                    lru_.splice(lru_.begin(), lru_, entry);
+                    ++hits_;
+                    return entry->features;
+                }
+                ++it;
+            }
+            ++misses_;
+            return nullptr;
+        }
+
+        void insert(std::string const &prefix, mapnik::box2d<double> const &bbox,
+                    wrapper::feature_vector_ptr features, std::size_t bytes) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (budget_ == 0 || bytes > budget_ / kMaxEntryShare) {
+                ++bypassed_;
+                return;
+            }
+            auto const expires = ttl_.count() > 0 ? cache_clock::now() + ttl_ : cache_clock::time_point::max();
+            lru_.push_front(cache_entry{prefix, bbox, std::move(features), bytes, expires});
+            index_.emplace(prefix, lru_.begin());
+            used_ += bytes;
+            evict_locked();
+        }
+
+        std::string stats_json() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return "{\"budget\":" + std::to_string(budget_) +
+                   ",\"ttl\":" + std::to_string(ttl_.count()) +
+                   ",\"bytes\":" + std::to_string(used_) +
+                   ",\"entries\":" + std::to_string(lru_.size()) +
+                   ",\"hits\":" + std::to_string(hits_) +
+                   ",\"misses\":" + std::to_string(misses_) +
+                   ",\"evictions\":" + std::to_string(evictions_) +
+                   ",\"expired\":" + std::to_string(expired_) +
+                   ",\"bypassed\":" + std::to_string(bypassed_) + "}";
+        }
+
+    private:
+        void evict_locked() {
+            while (used_ > budget_ && !lru_.empty()) {
+                auto last = std::prev(lru_.end());
+                auto range = index_.equal_range(last->prefix);
+                for (auto it = range.first; it != range.second; ++it) {
+                    if (it->second == last) {
+                        index_.erase(it);
+                        break;
+                    }
+                }
+                used_ -= last->bytes;
+                lru_.erase(last);
+                ++evictions_;
+            }
+        }
+
+        std::mutex mutex_;
+        std::list<cache_entry> lru_;
+        std::unordered_multimap<std::string, std::list<cache_entry>::iterator> index_;
+        std::size_t budget_ = 0;
+        std::chrono::seconds ttl_{0};
+        std::size_t used_ = 0;
+        std::uint64_t hits_ = 0;
+        std::uint64_t misses_ = 0;
+        std::uint64_t evictions_ = 0;
+        std::uint64_t expired_ = 0;
+        std::uint64_t bypassed_ = 0;
+    };
+
+    // Passes features through to the renderer while collecting the whole (snapped) fetch,
+    // which is handed to the cache once the source is exhausted. Streaming keeps PostGIS
+    // asynchronous queries asynchronous on a cache miss.
+    class filling_featureset : public mapnik::Featureset {
+    public:
+        using done_callback = std::function<void(wrapper::feature_vector_ptr, std::size_t)>;
+
+        filling_featureset(mapnik::featureset_ptr source, mapnik::box2d<double> const &bbox, done_callback done)
+            : source_(std::move(source)), bbox_(bbox), done_(std::move(done)),
+              features_(std::make_shared<wrapper::feature_vector>()) {}
+
+        mapnik::feature_ptr next() override {
+            if (source_) {
+                while (mapnik::feature_ptr feature = source_->next()) {
+                    bytes_ += wrapper::estimate_feature_bytes(*feature);
+                    features_->push_back(feature);
+                    if (feature->envelope().intersects(bbox_)) return feature;
+                }
+                source_.reset();
+            }
+            if (done_) {
+                done_(features_, bytes_);
+                done_ = nullptr;
+            }
+            return mapnik::feature_ptr();
+        }
+
+    private:
+        mapnik::featureset_ptr source_;
+        mapnik::box2d<double> bbox_;
+        done_callback done_;
+        std::shared_ptr<wrapper::feature_vector> features_;
+        std::size_t bytes_ = 0;
+    };
+
+    class cached_datasource : public wrapper::forwarding_datasource {
+    public:
+        cached_datasource(mapnik::datasource_ptr inner, std::string key)
+            : forwarding_datasource(std::move(inner)), key_(std::move(key)) {}
+
+        mapnik::featureset_ptr features(mapnik::query const &q) const override {
+            return fetch(q, [this](mapnik::query const &f) { return inner_->features(f); });
+        }
+
+        // Forwarded so Mapnik keeps using PostGIS asynchronous requests through the cache.
+        mapnik::processor_context_ptr get_context(mapnik::feature_style_context_map &ctx) const override {
+            return inner_->get_context(ctx);
+        }
+
+        mapnik::featureset_ptr features_with_context(mapnik::query const &q, mapnik::processor_context_ptr ctx) const override {
+            return fetch(q, [this, &ctx](mapnik::query const &f) { return inner_->features_with_context(f, ctx); });
+        }
+
+    private:
+        template <typename Source>
+        mapnik::featureset_ptr fetch(mapnik::query const &q, Source &&source) const {
+            auto &cache = feature_cache::instance();
+            double const res_x = std::get<0>(q.resolution());
+            double const res_y = std::get<1>(q.resolution());
+            if (cache.budget() == 0 || !(res_x > 0.0) || !(res_y > 0.0) || !(q.scale_denominator() > 0.0)) {
+                return source(q);
+            }
+
+            std::string prefix = make_prefix(q);
+            mapnik::box2d<double> const &bbox = q.get_bbox();
+            if (auto hit = cache.lookup(prefix, bbox)) {
+                return std::make_shared<wrapper::vector_featureset>(hit, bbox);
+            }
+
+            double const cell_x = kCellPixels / res_x;
+            double const cell_y = kCellPixels / res_y;
+            mapnik::box2d<double> snapped(std::floor(bbox.minx() / cell_x) * cell_x,
+                                          std::floor(bbox.miny() / cell_y) * cell_y,
+                                          std::ceil(bbox.maxx() / cell_x) * cell_x,
+                                          std::ceil(bbox.maxy() / cell_y) * cell_y);
+
+            mapnik::query fetch(snapped, q.resolution(), q.scale_denominator(), snapped);
+            fetch.set_filter_factor(q.get_filter_factor());
+            fetch.set_variables(q.variables());
+            for (auto const &name: q.property_names()) fetch.add_property_name(name);
+
+            return std::make_shared<filling_featureset>(
+                source(fetch), bbox,
+                [prefix = std::move(prefix), snapped](wrapper::feature_vector_ptr features, std::size_t bytes) {
+                    feature_cache::instance().insert(prefix, snapped, std::move(features), bytes);
+                });
+        }
+
+        std::string make_prefix(mapnik::query const &q) const {
+            // Quarter octaves of the scale denominator; keeps !scale_denominator! and
+            // !pixel_width! driven SQL close to what an uncached query would return.
+            long const band = std::lround(std::log2(q.scale_denominator()) * 4.0);
+            std::string prefix = key_ + '|' + std::to_string(band) + '|' + std::to_string(q.get_filter_factor()) + '|';
+            for (auto const &name: q.property_names()) {
+                prefix += name;
+                prefix += ',';
+            }
+            // !@var! substitutions change the SQL, so entries are only shared for equal variables.
+            std::map<std::string, std::string> variables;
+            for (auto const &var: q.variables()) variables.emplace(var.first, var.second.to_string());
+            for (auto const &var: variables) {
+                prefix += '|';
+                prefix += var.first;
+                prefix += '=';
+                prefix += var.second;
+            }
+            return prefix;
+        }
+
+        std::string key_;
+    };
+}
+
+extern "C" {
+    static thread_local std::string g_feature_cache_buffer;
+
+    EXPORT void feature_cache_configure(uint64_t budget_bytes, uint32_t ttl_seconds) {
+        feature_cache::instance().configure(static_cast<std::size_t>(budget_bytes), std::chrono::seconds(ttl_seconds));
+    }
+
+    EXPORT void feature_cache_clear() {
+        feature_cache::instance().clear();
+    }
+
+    EXPORT const char *feature_cache_stats() {
+        try {
+            g_feature_cache_buffer = feature_cache::instance().stats_json();
+            return g_feature_cache_buffer.c_str();
+        } catch (...) {
+            return "{}";
+        }
+    }
+
+    // Wraps the datasource of every layer of the given datasource types (comma separated,
+    // null or empty means postgis) with the shared cache. Returns the number of wrapped
+    // layers or -1 on error.
+    EXPORT int32_t map_enable_feature_cache(void *map_ptr, const char *types) {
+        if (!map_ptr) {
+            _set_last_error("map_enable_feature_cache: null map");
+            return -1;
+        }
+        try {
+            auto *map = static_cast<mapnik::Map *>(map_ptr);
+            std::set<std::string> cached_types;
+            std::istringstream in(types && *types ? types : "postgis");
+            for (std::string type; std::getline(in, type, ',');) {
+                if (!type.empty()) cached_types.insert(type);
+            }
+            int32_t wrapped = 0;
+            for (auto &lyr: map->layers()) {
+                mapnik::datasource_ptr ds = lyr.datasource();
+                if (!ds || dynamic_cast<cached_datasource *>(ds.get())) continue;
+                auto type = ds->params().get<std::string>("type");
+                if (!type || cached_types.count(*type) == 0) continue;
+                auto table = ds->params().get<std::string>("table");
+                std::string key = lyr.name() + '\x1f' + (table ? *table : std::string());
+                lyr.set_datasource(std::make_shared<cached_datasource>(ds, std::move(key)));
+                ++wrapped;
+            }
+            return wrapped;
+        } catch (std::exception const &ex) {
+            _set_last_error(ex.what());
+            return -1;
+        } catch (...) {
+            _set_last_error("map_enable_feature_cache: unknown error");
+            return -1;
+        }
+    }
+}
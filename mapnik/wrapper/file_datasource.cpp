@@ -0,0 +1,404 @@
+/*
+ * Copyright 2019-2025 Simon Zigelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "include/mapnik.h"
+#include "mapnik_internal.h"
+#include "datasource_internal.h"
+
+#include <mapnik/map.hpp>
+#include <mapnik/layer.hpp>
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+#include <mapnik/mapped_memory_cache.hpp>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <strings.h>
+
+// -----------------------------
+// Preloaded file datasources (shape/geojson)
+// One shared datasource instance per file and process. Shapefiles are mapped once
+// through Mapnik's mapped_memory_cache; GeoJSON keeps its in-memory R-tree.
+// A file claimed for index building is not registered or mapped by any thread
+// before the claiming thread has released it.
+// -----------------------------
+
+namespace {
+    namespace fs = std::filesystem;
+
+    constexpr char kIndexMagic[] = "mapnik-index";
+
+    std::string param_or_empty(mapnik::parameters const &params, std::string const &key) {
+        auto value = params.get<std::string>(key);
+        return value ? *value : std::string();
+    }
+
+    // Same path the plugins open: "<base>/<file>" without normalisation.
+    std::string datasource_file(mapnik::parameters const &params) {
+        std::string const file = param_or_empty(params, "file");
+        std::string const base = param_or_empty(params, "base");
+        if (file.empty()) return file;
+        return base.empty() ? file : base + "/" + file;
+    }
+
+    std::string shape_name(std::string const &file) {
+        if (file.size() >= 4 && strcasecmp(file.c_str() + file.size() - 4, ".shp") == 0) {
+            return file.substr(0, file.size() - 4);
+        }
+        return file;
+    }
+
+    std::string index_file(std::string const &type, std::string const &file) {
+        return type == "shape" ? shape_name(file) + ".index" : file + ".index";
+    }
+
+    // "ok", "missing", "stale" (older than the data file) or "invalid" (bad header).
+    std::string index_status(std::string const &type, std::string const &file) {
+        std::error_code ec;
+        std::string const idx = index_file(type, file);
+        std::string const data = type == "shape" ? shape_name(file) + ".shp" : file;
+        if (!fs::exists(idx, ec)) return "missing";
+
+        char header[sizeof(kIndexMagic) - 1] = {};
+        std::ifstream in(idx, std::ios::binary);
+        if (!in.read(header, sizeof(header)) || std::memcmp(header, kIndexMagic, sizeof(header)) != 0) {
+            return "invalid";
+        }
+        auto const idx_time = fs::last_write_time(idx, ec);
+        if (ec) return "invalid";
+        auto const data_time = fs::last_write_time(data, ec);
+        if (!ec && idx_time < data_time) return "stale";
+        return "ok";
+    }
+
+    std::string registry_key(mapnik::parameters const &params) {
+        return param_or_empty(params, "type") + '\x1f' + datasource_file(params) + '\x1f' +
+               param_or_empty(params, "encoding") + '\x1f' + param_or_empty(params, "cache_features");
+    }
+
+    bool is_file_datasource(mapnik::datasource_ptr const &ds) {
+        if (!ds) return false;
+        std::string const type = param_or_empty(ds->params(), "type");
+        return (type == "shape" || type == "geojson") && !param_or_empty(ds->params(), "file").empty();
+    }
+
+    // Maps a file into the process-wide cache and faults its pages in once.
+    std::size_t map_file(std::string const &path) {
+#if defined(MAPNIK_MEMORY_MAPPED_FILE)
+        std::error_code ec;
+        if (!fs::exists(path, ec)) return 0;
+        auto region = mapnik::mapped_memory_cache::instance().find(path, true);
+        if (!region || !(*region)) return 0;
+        auto const *bytes = static_cast<volatile unsigned char const *>((*region)->get_address());
+        std::size_t const size = (*region)->get_size();
+        unsigned char sink = 0;
+        for (std::size_t i = 0; i < size; i += 4096) sink ^= bytes[i];
+        (void) sink;
+        return size;
+#else
+        (void) path;
+        return 0;
+#endif
+    }
+
+    struct file_stats {
+        std::atomic<std::uint64_t> queries{0};
+        std::atomic<std::uint64_t> features{0};
+    };
+
+    class counting_featureset : public mapnik::Featureset {
+    public:
+        counting_featureset(mapnik::featureset_ptr inner, std::shared_ptr<file_stats> stats)
+            : inner_(std::move(inner)), stats_(std::move(stats)) {}
+
+        mapnik::feature_ptr next() override {
+            mapnik::feature_ptr feature = inner_->next();
+            if (feature) stats_->features.fetch_add(1, std::memory_order_relaxed);
+            return feature;
+        }
+
+    private:
+        mapnik::featureset_ptr inner_;
+        std::shared_ptr<file_stats> stats_;
+    };
+
+    class shared_file_datasource : public wrapper::forwarding_datasource {
+    public:
+        shared_file_datasource(mapnik::datasource_ptr inner, std::shared_ptr<file_stats> stats)
+            : forwarding_datasource(std::move(inner)), stats_(std::move(stats)) {}
+
+        mapnik::featureset_ptr features(mapnik::query const &q) const override {
+            stats_->queries.fetch_add(1, std::memory_order_relaxed);
+            mapnik::featureset_ptr fs = inner_->features(q);
+            if (!fs) return fs;
+            return std::make_shared<counting_featureset>(fs, stats_);
+        }
+
+    private:
+        std::shared_ptr<file_stats> stats_;
+    };
+
+    struct preloaded_file {
+        std::string type;
+        std::string file;
+        std::string index;
+        std::size_t mapped_bytes = 0;
+        std::shared_ptr<file_stats> stats;
+        mapnik::datasource_ptr datasource;
+    };
+
+    // Upper bound for waiting on another thread's index build.
+    constexpr auto kClaimTimeout = std::chrono::minutes(10);
+
+    struct registry {
+        std::mutex mutex;
+        std::condition_variable released;
+        std::map<std::string, preloaded_file> files;
+        // Claimed files; true once the claiming thread released them.
+        std::map<std::string, bool> claims;
+
+        static registry &instance() {
+            static registry r;
+            return r;
+        }
+
+        // Waits (lock held) until no claim on one of the files is pending; false on timeout.
+        bool wait_released(std::unique_lock<std::mutex> &lock, std::set<std::string> const &paths) {
+            return released.wait_for(lock, kClaimTimeout, [&] {
+                for (auto const &path: paths) {
+                    auto it = claims.find(path);
+                    if (it != claims.end() && !it->second) return false;
+                }
+                return true;
+            });
+        }
+    };
+
+    // Claims are made for the .shp path shown by map_file_datasources.
+    std::string claim_path(std::string const &type, std::string const &file) {
+        return type == "shape" ? shape_name(file) + ".shp" : file;
+    }
+}
+
+extern "C" {
+    static thread_local std::string g_file_datasource_buffer;
+
+    // Lists the shape/geojson datasources of a loaded map with their spatial index status.
+    EXPORT const char *map_file_datasources(void *map_ptr) {
+        if (!map_ptr) {
+            _set_last_error("map_file_datasources: null map");
+            return "[]";
+        }
+        try {
+            auto *map = static_cast<mapnik::Map *>(map_ptr);
+            std::set<std::string> seen;
+            std::string json = "[";
+            for (auto const &lyr: map->layers()) {
+                mapnik::datasource_ptr ds = lyr.datasource();
+                if (auto const *shared = dynamic_cast<shared_file_datasource const *>(ds.get())) ds = shared->inner();
+                if (!is_file_datasource(ds)) continue;
+                std::string const type = param_or_empty(ds->params(), "type");
+                std::string const file = datasource_file(ds->params());
+                if (!seen.insert(type + file).second) continue;
+                if (json.size() > 1) json += ",";
+                json += "{\"layer\":\"" + json_escape(lyr.name()) + "\",\"type\":\"" + type +
+                        "\",\"file\":\"" + json_escape(type == "shape" ? shape_name(file) + ".shp" : file) +
+                        "\",\"index\":\"" + index_status(type, file) + "\"}";
+            }
+            json += "]";
+            g_file_datasource_buffer = std::move(json);
+            return g_file_datasource_buffer.c_str();
+        } catch (std::exception const &ex) {
+            _set_last_error(ex.what());
+            return "[]";
+        } catch (...) {
+            _set_last_error("map_file_datasources: unknown error");
+            return "[]";
+        }
+    }
+
+    // Returns 1 for the first caller in the process that claims a file (e.g. to build its index), else 0.
+    // The claiming thread must call file_datasource_release when done, other threads wait for it.
+    EXPORT int32_t file_datasource_claim(const char *file) {
+        if (!file) {
+            _set_last_error("file_datasource_claim: null file");
+            return 0;
+        }
+        auto &reg = registry::instance();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        return reg.claims.emplace(std::string(file), false).second ? 1 : 0;
+    }
+
+    EXPORT void file_datasource_release(const char *file) {
+        if (!file) return;
+        auto &reg = registry::instance();
+        {
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            auto it = reg.claims.find(std::string(file));
+            if (it == reg.claims.end()) return;
+            it->second = true;
+        }
+        reg.released.notify_all();
+    }
+
+    // Blocks until the claims on the given files (newline separated) are released.
+    // Returns 1, or 0 if another thread did not release in time.
+    EXPORT int32_t file_datasource_wait(const char *files) {
+        if (!files) return 1;
+        std::set<std::string> paths;
+        std::istringstream in(files);
+        for (std::string path; std::getline(in, path);) {
+            if (!path.empty()) paths.insert(path);
+        }
+        auto &reg = registry::instance();
+        std::unique_lock<std::mutex> lock(reg.mutex);
+        if (!reg.wait_released(lock, paths)) {
+            _set_last_error("file_datasource_wait: timed out waiting for a claimed file");
+            return 0;
+        }
+        return 1;
+    }
+
+    // Registers the file datasources of a loaded map as process-wide shared instances
+    // and maps their files. Idempotent; returns the number of newly registered files or -1.
+    EXPORT int32_t map_preload_file_datasources(void *map_ptr) {
+        if (!map_ptr) {
+            _set_last_error("map_preload_file_datasources: null map");
+            return -1;
+        }
+        try {
+            auto *map = static_cast<mapnik::Map *>(map_ptr);
+            auto &reg = registry::instance();
+            int32_t added = 0;
+            for (auto const &lyr: map->layers()) {
+                mapnik::datasource_ptr ds = lyr.datasource();
+                if (!is_file_datasource(ds) || dynamic_cast<shared_file_datasource const *>(ds.get())) continue;
+                std::string const key = registry_key(ds->params());
+                preloaded_file entry;
+                entry.type = param_or_empty(ds->params(), "type");
+                entry.file = datasource_file(ds->params());
+                {
+                    // Never map a file whose index another thread is still writing.
+                    std::unique_lock<std::mutex> lock(reg.mutex);
+                    if (!reg.wait_released(lock, {claim_path(entry.type, entry.file)})) {
+                        _set_last_error("map_preload_file_datasources: timed out waiting for a claimed file");
+                        return -1;
+                    }
+                    if (reg.files.count(key)) continue;
+                }
+
+                entry.index = index_status(entry.type, entry.file);
+                if (entry.type == "shape") {
+                    std::string const name = shape_name(entry.file);
+                    for (char const *ext: {".shp", ".shx", ".dbf", ".index"}) {
+                        entry.mapped_bytes += map_file(name + ext);
+                    }
+                }
+                entry.stats = std::make_shared<file_stats>();
+                entry.datasource = std::make_shared<shared_file_datasource>(ds, entry.stats);
+
+                std::lock_guard<std::mutex> lock(reg.mutex);
+                if (reg.files.emplace(key, std::move(entry)).second) ++added;
+            }
+            return added;
+        } catch (std::exception const &ex) {
+            _set_last_error(ex.what());
+            return -1;
+        } catch (...) {
+            _set_last_error("map_preload_file_datasources: unknown error");
+            return -1;
+        }
+    }
+
+    // Swaps file datasources of a freshly loaded map for the preloaded shared instances.
+    // Returns the number of replaced layers or -1.
+    EXPORT int32_t map_use_preloaded_datasources(void *map_ptr) {
+        if (!map_ptr) {
+            _set_last_error("map_use_preloaded_datasources: null map");
+            return -1;
+        }
+        try {
+            auto *map = static_cast<mapnik::Map *>(map_ptr);
+            auto &reg = registry::instance();
+            int32_t replaced = 0;
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            if (reg.files.empty()) return 0;
+            for (auto &lyr: map->layers()) {
+                mapnik::datasource_ptr ds = lyr.datasource();
+                if (!is_file_datasource(ds) || dynamic_cast<shared_file_datasource const *>(ds.get())) continue;
+                auto it = reg.files.find(registry_key(ds->params()));
+                if (it == reg.files.end()) continue;
+                lyr.set_datasource(it->second.datasource);
+                ++replaced;
+            }
+            return replaced;
+        } catch (std::exception const &ex) {
+            _set_last_error(ex.what());
+            return -1;
+        } catch (...) {
+            _set_last_error("map_use_preloaded_datasources: unknown error");
+            return -1;
+        }
+    }
+
+    // indexed_query_share = share of queries sent to a datasource that had a valid spatial
+    // index (shape .index file, or GeoJSON's in-memory tree) when it was registered. It does
+    // not tell whether the index was used for a query.
+    EXPORT const char *file_datasource_stats() {
+        try {
+            auto &reg = registry::instance();
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            std::uint64_t queries = 0;
+            std::uint64_t indexed = 0;
+            std::size_t mapped = 0;
+            std::string files = "[";
+            for (auto const &[key, entry]: reg.files) {
+                std::uint64_t const q = entry.stats->queries.load(std::memory_order_relaxed);
+                bool const has_index = entry.index == "ok" ||
+                                       (entry.type == "geojson" &&
+                                        param_or_empty(entry.datasource->params(), "cache_features") != "false");
+                queries += q;
+                if (has_index) indexed += q;
+                mapped += entry.mapped_bytes;
+                if (files.size() > 1) files += ",";
+                files += "{\"type\":\"" + entry.type + "\",\"file\":\"" + json_escape(entry.file) +
+                         "\",\"index\":\"" + entry.index + "\",\"indexed\":" + (has_index ? "true" : "false") +
+                         ",\"mapped_bytes\":" + std::to_string(entry.mapped_bytes) +
+                         ",\"queries\":" + std::to_string(q) +
+                         ",\"features\":" + std::to_string(entry.stats->features.load(std::memory_order_relaxed)) + "}";
+            }
+            files += "]";
+            double const rate = queries ? static_cast<double>(indexed) / static_cast<double>(queries) : 0.0;
+            g_file_datasource_buffer = "{\"queries\":" + std::to_string(queries) +
+                                       ",\"indexed_queries\":" + std::to_string(indexed) +
+                                       ",\"indexed_query_share\":" + std::to_string(rate) +
+                                       ",\"mapped_bytes\":" + std::to_string(mapped) +
+                                       ",\"files\":" + files + "}";
+            return g_file_datasource_buffer.c_str();
+        } catch (...) {
+            return "{}";
+        }
+    }
+}
@@ -18,6 +18,11 @@
 #include "mapnik_internal.h"
 
 #include <mapnik/font_engine_freetype.hpp>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <iomanip>
@@ -35,6 +40,17 @@ std::string json_escape(const std::string& s) {
     return o.str();
 }
 
+namespace {
+    // Pre-warming counters. Mapnik keeps font files in a process-wide memory cache
+    // (freetype_engine::get_cache) shared by all worker threads; the first worker loads
+    // a face from disk, later workers find it there.
+    std::atomic<uint64_t> g_prewarm_loaded{0};
+    std::atomic<uint64_t> g_prewarm_reused{0};
+    std::atomic<uint64_t> g_prewarm_failed{0};
+    std::mutex g_prewarm_mutex;
+    std::set<std::string> g_prewarmed_faces;
+}
+
 extern "C" {
     static thread_local std::string g_font_info_buffer;
     EXPORT bool register_fonts(const char *path, const bool recurse) {
@@ -62,12 +78,25 @@ extern "C" {
         }
     }
 
+    // Only the cache size is read from Mapnik; the prewarm figures are our own counters.
+    // Mapnik's font structures are written by rendering threads under the engine's private
+    // mutex, so they are not iterated here.
     EXPORT const char* fonts_get_cache() {
         try {
-            // get_cache returns a map of font names to face objects (internal)
-            // Since we cannot easily serialize the objects, we return the count as a JSON info
-            auto const& cache = mapnik::freetype_engine::get_cache();
-            g_font_info_buffer = "{\"count\":" + std::to_string(cache.size()) + "}";
+            std::size_t const count = mapnik::freetype_engine::get_cache().size();
+            std::size_t prewarmed = 0;
+            {
+                std::lock_guard<std::mutex> lock(g_prewarm_mutex);
+                prewarmed = g_prewarmed_faces.size();
+            }
+            std::ostringstream o;
+            o << "{\"count\":" << count
+              << ",\"prewarmed\":" << prewarmed
+              << ",\"prewarm_loaded\":" << g_prewarm_loaded.load()
+              << ",\"prewarm_reused\":" << g_prewarm_reused.load()
+              << ",\"prewarm_failed\":" << g_prewarm_failed.load()
+              << "}";
+            g_font_info_buffer = o.str();
             return g_font_info_buffer.c_str();
         } catch (...) {
             return "{}";
@@ -103,4 +132,47 @@ extern "C" {
             return "{}";
         }
     }
+
+    // Opens the given faces (newline separated) once so their font files are in the
+    // process-wide memory cache before the first label is rendered. create_face loads into
+    // that cache under Mapnik's own lock; calls are serialised so workers starting together
+    // do not read the same file concurrently. Faces prewarmed before in this process are
+    // counted as reused, unknown faces as failed. Returns the number of faces that could be
+    // opened, -1 on error.
+    EXPORT int32_t fonts_prewarm(const char* faces) {
+        if (!faces) {
+            _set_last_error("fonts_prewarm: null faces");
+            return -1;
+        }
+        try {
+            std::lock_guard<std::mutex> lock(g_prewarm_mutex);
+            mapnik::freetype_engine::font_file_mapping_type const no_mapping;
+            mapnik::freetype_engine::font_memory_cache_type const no_cache;
+            mapnik::font_library library;
+
+            int32_t opened = 0;
+            std::istringstream in(faces);
+            std::string name;
+            while (std::getline(in, name)) {
+                if (name.empty()) continue;
+                auto face = mapnik::freetype_engine::create_face(name, library, no_mapping, no_cache,
+                                                                 mapnik::freetype_engine::get_mapping(),
+                                                                 mapnik::freetype_engine::get_cache());
+                if (!face) {
+                    g_prewarm_failed++;
+                    continue;
+                }
+                if (g_prewarmed_faces.insert(name).second) g_prewarm_loaded++;
+                else g_prewarm_reused++;
+                opened++;
+            }
+            return opened;
+        } catch (std::exception const &ex) {
+            _set_last_error(ex.what());
+            return -1;
+        } catch (...) {
+            _set_last_error("fonts_prewarm: unknown error");
+            return -1;
+        }
+    }
 }
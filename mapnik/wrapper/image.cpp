@@ -26,6 +26,92 @@
 #include <mapnik/cairo/cairo_io.hpp>
 #endif
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+    // Area-average (box) resampling of RGBA8. Straight alpha is alpha weighted so transparent
+    // pixels do not bleed; premultiplied colour is averaged as is and stays premultiplied.
+    // Only downsampling; each source row is filtered horizontally once. The inner loops are
+    // plain float loops that vectorise at -O3.
+    void resize_box_rgba8(uint8_t const *src, std::size_t sw, std::size_t sh,
+                          uint8_t *dst, std::size_t dw, std::size_t dh, bool premultiplied) {
+        double const sx = static_cast<double>(sw) / static_cast<double>(dw);
+        double const sy = static_cast<double>(sh) / static_cast<double>(dh);
+
+        // Horizontal spans: for output column x the source columns first[x] .. first[x] + count[x] - 1.
+        std::vector<std::size_t> first(dw), count(dw), offset(dw);
+        std::vector<float> weights;
+        for (std::size_t x = 0; x < dw; ++x) {
+            double const x0 = x * sx;
+            double const x1 = std::min(static_cast<double>(sw), (x + 1) * sx);
+            std::size_t const i0 = static_cast<std::size_t>(x0);
+            std::size_t const i1 = std::min(sw, static_cast<std::size_t>(std::ceil(x1)));
+            first[x] = i0;
+            count[x] = i1 - i0;
+            offset[x] = weights.size();
+            for (std::size_t i = i0; i < i1; ++i) {
+                double const w = std::min(x1, static_cast<double>(i + 1)) - std::max(x0, static_cast<double>(i));
+                weights.push_back(static_cast<float>(w));
+            }
+        }
+
+        std::vector<float> row(dw * 4), acc(dw * 4);
+        std::size_t cached_row = sh;
+        auto filter_row = [&](std::size_t j) {
+            if (cached_row == j) return;
+            uint8_t const *s = src + j * sw * 4;
+            for (std::size_t x = 0; x < dw; ++x) {
+                float r = 0.f, g = 0.f, b = 0.f, a = 0.f;
+                uint8_t const *p = s + first[x] * 4;
+                float const *w = weights.data() + offset[x];
+                for (std::size_t k = 0; k < count[x]; ++k, p += 4) {
+                    float const pa = p[3] * w[k];
+                    float const pc = premultiplied ? w[k] : pa;
+                    r += p[0] * pc;
+                    g += p[1] * pc;
+                    b += p[2] * pc;
+                    a += pa;
+                }
+                row[x * 4] = r;
+                row[x * 4 + 1] = g;
+                row[x * 4 + 2] = b;
+                row[x * 4 + 3] = a;
+            }
+            cached_row = j;
+        };
+
+        float const area = static_cast<float>(sx * sy);
+        for (std::size_t y = 0; y < dh; ++y) {
+            double const y0 = y * sy;
+            double const y1 = std::min(static_cast<double>(sh), (y + 1) * sy);
+            std::size_t const j0 = static_cast<std::size_t>(y0);
+            std::size_t const j1 = std::min(sh, static_cast<std::size_t>(std::ceil(y1)));
+            std::fill(acc.begin(), acc.end(), 0.f);
+            for (std::size_t j = j0; j < j1; ++j) {
+                float const w = static_cast<float>(std::min(y1, static_cast<double>(j + 1)) - std::max(y0, static_cast<double>(j)));
+                filter_row(j);
+                for (std::size_t i = 0; i < acc.size(); ++i) acc[i] += row[i] * w;
+            }
+            uint8_t *d = dst + y * dw * 4;
+            for (std::size_t x = 0; x < dw; ++x) {
+                float const a = acc[x * 4 + 3];
+                if (a <= 0.f) {
+                    d[x * 4] = d[x * 4 + 1] = d[x * 4 + 2] = d[x * 4 + 3] = 0;
+                    continue;
+                }
+                float const norm = premultiplied ? area : a;
+                for (std::size_t c = 0; c < 3; ++c) {
+                    d[x * 4 + c] = static_cast<uint8_t>(std::min(255.f, acc[x * 4 + c] / norm + 0.5f));
+                }
+                d[x * 4 + 3] = static_cast<uint8_t>(std::min(255.f, a / area + 0.5f));
+            }
+        }
+    }
+}
+
 extern "C" {
 
     // -----------------------------
@@ -90,4 +176,74 @@ extern "C" {
             return nullptr;
         }
     }
+
+    // Rough peak native memory of one render at the given size, used for admission control.
+    // Raster: RGBA8 canvas, AGG scanline/cell buffers and the encoded copy. Vector: Cairo
+    // recording and output stream. Both include a fixed share for map, styles and datasources.
+    // defaultMemoryEstimate in scheduler.ts repeats this for MOCK mode; a test keeps them equal.
+    EXPORT uint64_t render_memory_estimate(int32_t width, int32_t height, int32_t vector) {
+        if (width <= 0 || height <= 0) return 0;
+        constexpr uint64_t base = 32ull * 1024 * 1024;
+        uint64_t const pixels = static_cast<uint64_t>(width) * static_cast<uint64_t>(height);
+        uint64_t const canvas = pixels * sizeof(mapnik::image_rgba8::pixel_type);
+        if (vector) return base + canvas / 2;
+        return base + canvas * 3;
+    }
+
+    // Returns a downsampled copy (box filter), free with image_free. Sizes larger than the
+    // source are rejected; derivatives are only ever smaller than the rendered map.
+    EXPORT void *image_resize_box(void *img_ptr, int32_t width, int32_t height) {
+        if (!img_ptr) {
+            _set_last_error("image_resize_box: null image");
+            return nullptr;
+        }
+        try {
+            auto *im = static_cast<mapnik::image_rgba8 *>(img_ptr);
+            if (width <= 0 || height <= 0 || static_cast<std::size_t>(width) > im->width() ||
+                static_cast<std::size_t>(height) > im->height()) {
+                _set_last_error("image_resize_box: invalid size");
+                return nullptr;
+            }
+            auto *out = new mapnik::image_rgba8(width, height);
+            resize_box_rgba8(im->bytes(), im->width(), im->height(), out->bytes(), out->width(), out->height(),
+                             im->get_premultiplied());
+            out->set_premultiplied(im->get_premultiplied());
+            return out;
+        } catch (std::exception const &ex) {
+            _set_last_error(ex.what());
+            return nullptr;
+        } catch (...) {
+            _set_last_error("image_resize_box: unknown error");
+            return nullptr;
+        }
+    }
+
+    // Copies the rectangle (x, y, width, height) into a new image, free with image_free.
+    EXPORT void *image_crop(void *img_ptr, int32_t x, int32_t y, int32_t width, int32_t height) {
+        if (!img_ptr) {
+            _set_last_error("image_crop: null image");
+            return nullptr;
+        }
+        try {
+            auto *im = static_cast<mapnik::image_rgba8 *>(img_ptr);
+            if (x < 0 || y < 0 || width <= 0 || height <= 0 ||
+                static_cast<std::size_t>(x) + static_cast<std::size_t>(width) > im->width() ||
+                static_cast<std::size_t>(y) + static_cast<std::size_t>(height) > im->height()) {
+                _set_last_error("image_crop: rectangle outside of image");
+                return nullptr;
+            }
+            auto *out = new mapnik::image_rgba8(width, height);
+            for (int32_t row = 0; row < height; ++row) {
+                std::memcpy(out->get_row(row), im->get_row(y + row) + x, width * sizeof(mapnik::image_rgba8::pixel_type));
+            }
+            out->set_premultiplied(im->get_premultiplied());
+            return out;
+        } catch (std::exception const &ex) {
+            _set_last_error(ex.what());
+            return nullptr;
+        } catch (...) {
+            _set_last_error("image_crop: unknown error");
+            return nullptr;
+        }
+    }
 }
@@ -18,8 +18,16 @@
 #include "mapnik_internal.h"
 
 #include <mapnik/map.hpp>
+#include <mapnik/layer.hpp>
 #include <mapnik/load_map.hpp>
+#include <mapnik/save_map.hpp>
 #include <mapnik/agg_renderer.hpp>
+#include <mapnik/image.hpp>
+#include <mapnik/label_collision_detector.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
 
 extern "C" {
 
@@ -37,6 +45,26 @@ EXPORT void *map_new(const int32_t width, const int32_t height) {
     }
 }
 
+// Copy of a loaded map at another size. Styles and layers are copied, datasources are shared
+// with the source map, so nothing is parsed or connected again.
+EXPORT void *map_clone(void *map_ptr, const int32_t width, const int32_t height) {
+    if (!map_ptr || width <= 0 || height <= 0) {
+        _set_last_error("map_clone: null map or invalid size");
+        return nullptr;
+    }
+    try {
+        auto *map = new mapnik::Map(*static_cast<mapnik::Map *>(map_ptr));
+        map->resize(static_cast<unsigned>(width), static_cast<unsigned>(height));
+        return map;
+    } catch (std::exception const &ex) {
+        _set_last_error(ex.what());
+        return nullptr;
+    } catch (...) {
+        _set_last_error("map_clone: unknown error");
+        return nullptr;
+    }
+}
+
 EXPORT void map_free(void *map_ptr) {
     if (map_ptr) {
         delete static_cast<mapnik::Map *>(map_ptr);
@@ -85,6 +113,27 @@ EXPORT int32_t map_load_string(void *map_ptr, const char *xml, const char *base_
     }
 }
 
+// Loads style XML as if it had been read from filename by map_load: not strict, and relative
+// paths resolve against the file's directory. For styles rewritten before loading.
+EXPORT int32_t map_load_string_as(void *map_ptr, const char *xml, const char *filename) {
+    if (!map_ptr || !xml || !filename) {
+        _set_last_error("map_load_string_as: null map, xml or filename");
+        return 0;
+    }
+    auto *map = static_cast<mapnik::Map *>(map_ptr);
+    try {
+        // load_map_string resolves against the parent of base_path, like load_map does with the filename.
+        mapnik::load_map_string(*map, std::string(xml), false, std::string(filename));
+        return 1;
+    } catch (std::exception const &ex) {
+        _set_last_error(ex.what());
+        return 0;
+    } catch (...) {
+        _set_last_error("map_load_string_as: unknown error");
+        return 0;
+    }
+}
+
 EXPORT void map_zoom_all(void *map_ptr) {
     if (map_ptr) {
         auto *map = static_cast<mapnik::Map *>(map_ptr);
@@ -121,6 +170,63 @@ EXPORT void map_render(void *map_ptr, void *img_ptr) {
     }
 }
 
+// Renders large maps tile by tile into img (same size as the map) to bound AGG's working
+// memory to one tile. Every tile is a view of the whole map shifted by its offset, so layers
+// keep their order, geometries continue across tile edges, and each tile places labels and
+// markers from the same features in the same order, exactly as an untiled render does. That
+// costs every tile the query and placement work of the whole map, so maps no larger than a
+// tile (in pixels) are rendered untiled. The map is not modified.
+EXPORT int32_t map_render_tiled(void *map_ptr, void *img_ptr, int32_t tile_size) {
+    if (!map_ptr || !img_ptr) {
+        _set_last_error("map_render_tiled: null map or image");
+        return 0;
+    }
+    auto *map = static_cast<mapnik::Map *>(map_ptr);
+    auto *im = static_cast<mapnik::image_rgba8 *>(img_ptr);
+    unsigned const width = map->width();
+    unsigned const height = map->height();
+    if (im->width() != width || im->height() != height || tile_size <= 0) {
+        _set_last_error("map_render_tiled: image size differs from map or invalid tile size");
+        return 0;
+    }
+
+    try {
+        unsigned const tile = static_cast<unsigned>(tile_size);
+        if (static_cast<uint64_t>(width) * height <= static_cast<uint64_t>(tile) * tile) {
+            mapnik::agg_renderer<mapnik::image_rgba8> ren(*map, *im);
+            ren.apply();
+            return 1;
+        }
+
+        double const buffer_size = map->buffer_size();
+        for (unsigned ty = 0; ty < height; ty += tile) {
+            for (unsigned tx = 0; tx < width; tx += tile) {
+                unsigned const tw = std::min(tile, width - tx);
+                unsigned const th = std::min(tile, height - ty);
+                // The renderer's default detector spans the map at offset 0. Placement
+                // coordinates are shifted by the offset, so shift its extent with them.
+                auto detector = std::make_shared<mapnik::label_collision_detector4>(
+                        mapnik::box2d<double>(-buffer_size - tx, -buffer_size - ty,
+                                              width + buffer_size - tx, height + buffer_size - ty));
+                mapnik::image_rgba8 buffer(tw, th);
+                mapnik::agg_renderer<mapnik::image_rgba8> ren(*map, buffer, detector, 1.0, tx, ty);
+                ren.apply();
+                for (unsigned row = 0; row < th; ++row) {
+                    std::memcpy(im->get_row(ty + row) + tx, buffer.get_row(row),
+                                tw * sizeof(mapnik::image_rgba8::pixel_type));
+                }
+            }
+        }
+        return 1;
+    } catch (std::exception const &ex) {
+        _set_last_error(ex.what());
+        return 0;
+    } catch (...) {
+        _set_last_error("map_render_tiled: unknown error");
+        return 0;
+    }
+}
+
 EXPORT int32_t map_add_layer(void *map_ptr, void *layer_ptr) {
     if (!map_ptr || !layer_ptr) {
         _set_last_error("map_add_layer: null map or layer");
@@ -346,6 +452,37 @@ EXPORT int32_t map_get_extent(void *map_ptr, double *out4) {
     }
 }
 
+static thread_local std::string g_map_srs_buffer;
+static thread_local std::string g_map_xml_buffer;
+
+// SRS of the map (e.g. from the loaded style); empty string on error.
+EXPORT const char *map_get_srs(void *map_ptr) {
+    if (!map_ptr) {
+        _set_last_error("map_get_srs: null map");
+        return "";
+    }
+    g_map_srs_buffer = static_cast<mapnik::Map *>(map_ptr)->srs();
+    return g_map_srs_buffer.c_str();
+}
+
+// The map serialized as Mapnik XML (styles, layers, parameters); empty string on error.
+EXPORT const char *map_save_string(void *map_ptr) {
+    if (!map_ptr) {
+        _set_last_error("map_save_string: null map");
+        return "";
+    }
+    try {
+        g_map_xml_buffer = mapnik::save_map_to_string(*static_cast<mapnik::Map *>(map_ptr));
+        return g_map_xml_buffer.c_str();
+    } catch (std::exception const &ex) {
+        _set_last_error(ex.what());
+        return "";
+    } catch (...) {
+        _set_last_error("map_save_string: unknown error");
+        return "";
+    }
+}
+
 EXPORT int32_t map_load_fonts(void *map_ptr) {
     if (!map_ptr) {
         _set_last_error("map_load_fonts: null map");
@@ -16,6 +16,12 @@
 
 #pragma once
 
+#ifdef __cplusplus
+#include <string>
+
+std::string json_escape(const std::string& s);
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -0,0 +1,499 @@
+/*
+ * Copyright 2019-2025 Simon Zigelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "include/mapnik.h"
+#include "mapnik_internal.h"
+#include "projection_internal.h"
+
+#include <mapnik/map.hpp>
+#include <mapnik/layer.hpp>
+#include <mapnik/datasource.hpp>
+#include <mapnik/feature.hpp>
+#include <mapnik/featureset.hpp>
+#include <mapnik/query.hpp>
+#include <mapnik/unicode.hpp>
+#include <mapnik/value.hpp>
+#include <mapnik/geometry.hpp>
+#include <mapnik/util/variant.hpp>
+
+#include <protozero/pbf_writer.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// -----------------------------
+// Mapbox Vector Tiles
+// Encodes selected layers of a map for one web mercator z/x/y tile (MVT 2.1):
+// geometries are projected into tile space, clipped to the buffered tile,
+// quantised to the tile extent and written with protozero.
+// -----------------------------
+
+namespace {
+    constexpr double kMercatorHalf = 20037508.342789244;
+    constexpr std::uint32_t kExtent = 4096;
+    // Layers are selected and queried as for a raster tile of this many pixels at 0.28 mm per
+    // pixel, which is what the usual web map zoom levels and style scale ranges assume.
+    constexpr double kTileSize = 256.0;
+    constexpr double kBuffer = 64.0;
+    constexpr char const *kMercatorSrs = "epsg:3857";
+
+    // Message and field numbers of vector_tile.proto
+    enum : protozero::pbf_tag_type {
+        tile_layers = 3,
+        layer_name = 1, layer_features = 2, layer_keys = 3, layer_values = 4, layer_extent = 5, layer_version = 15,
+        feature_id = 1, feature_tags = 2, feature_type = 3, feature_geometry = 4,
+        value_string = 1, value_double = 3, value_sint = 6, value_bool = 7
+    };
+
+    enum geom_type : std::uint32_t { geom_point = 1, geom_linestring = 2, geom_polygon = 3 };
+
+    struct dpoint {
+        double x;
+        double y;
+    };
+
+    using dline = std::vector<dpoint>;
+
+    struct ipoint {
+        std::int32_t x;
+        std::int32_t y;
+    };
+
+    using iline = std::vector<ipoint>;
+
+    // Sutherland-Hodgman against one edge of the clip box.
+    template <typename Inside, typename Intersect>
+    dline clip_edge(dline const &ring, Inside inside, Intersect intersect) {
+        dline out;
+        if (ring.empty()) return out;
+        dpoint prev = ring.back();
+        bool prev_in = inside(prev);
+        for (auto const &cur: ring) {
+            bool const cur_in = inside(cur);
+            if (cur_in) {
+                if (!prev_in) out.push_back(intersect(prev, cur));
+                out.push_back(cur);
+            } else if (prev_in) {
+                out.push_back(intersect(prev, cur));
+            }
+            prev = cur;
+            prev_in = cur_in;
+        }
+        return out;
+    }
+
+    // Open ring (no repeated closing point) clipped to [lo, hi] on both axes.
+    dline clip_ring(dline ring, double lo, double hi) {
+        auto at_x = [](dpoint a, dpoint b, double x) { return dpoint{x, a.y + (b.y - a.y) * (x - a.x) / (b.x - a.x)}; };
+        auto at_y = [](dpoint a, dpoint b, double y) { return dpoint{a.x + (b.x - a.x) * (y - a.y) / (b.y - a.y), y}; };
+        ring = clip_edge(ring, [lo](dpoint p) { return p.x >= lo; }, [&](dpoint a, dpoint b) { return at_x(a, b, lo); });
+        ring = clip_edge(ring, [hi](dpoint p) { return p.x <= hi; }, [&](dpoint a, dpoint b) { return at_x(a, b, hi); });
+        ring = clip_edge(ring, [lo](dpoint p) { return p.y >= lo; }, [&](dpoint a, dpoint b) { return at_y(a, b, lo); });
+        ring = clip_edge(ring, [hi](dpoint p) { return p.y <= hi; }, [&](dpoint a, dpoint b) { return at_y(a, b, hi); });
+        return ring;
+    }
+
+    // Liang-Barsky per segment; a line leaving and re-entering the box is split.
+    std::vector<dline> clip_line(dline const &line, double lo, double hi) {
+        std::vector<dline> parts;
+        dline current;
+        for (std::size_t i = 1; i < line.size(); ++i) {
+            dpoint const a = line[i - 1];
+            dpoint const b = line[i];
+            double const dx = b.x - a.x;
+            double const dy = b.y - a.y;
+            double t0 = 0.0, t1 = 1.0;
+            bool visible = true;
+            double const p[4] = {-dx, dx, -dy, dy};
+            double const q[4] = {a.x - lo, hi - a.x, a.y - lo, hi - a.y};
+            for (int k = 0; k < 4 && visible; ++k) {
+                if (p[k] == 0.0) {
+                    if (q[k] < 0.0) visible = false;
+                } else {
+                    double const t = q[k] / p[k];
+                    if (p[k] < 0.0) t0 = std::max(t0, t);
+                    else t1 = std::min(t1, t);
+                    if (t0 > t1) visible = false;
+                }
+            }
+            if (!visible) {
+                if (current.size() > 1) parts.push_back(std::move(current));
+                current.clear();
+                continue;
+            }
+            dpoint const start{a.x + t0 * dx, a.y + t0 * dy};
+            dpoint const end{a.x + t1 * dx, a.y + t1 * dy};
+            if (current.empty()) current.push_back(start);
+            current.push_back(end);
+            if (t1 < 1.0) {
+                if (current.size() > 1) parts.push_back(std::move(current));
+                current.clear();
+            }
+        }
+        if (current.size() > 1) parts.push_back(std::move(current));
+        return parts;
+    }
+
+    // Rounds to the tile grid and drops repeated points.
+    iline quantise(dline const &line) {
+        iline out;
+        out.reserve(line.size());
+        for (auto const &p: line) {
+            ipoint const q{static_cast<std::int32_t>(std::lround(p.x)), static_cast<std::int32_t>(std::lround(p.y))};
+            if (out.empty() || out.back().x != q.x || out.back().y != q.y) out.push_back(q);
+        }
+        return out;
+    }
+
+    // Twice the signed area (surveyor's formula) in tile coordinates.
+    std::int64_t ring_area(iline const &ring) {
+        std::int64_t area = 0;
+        for (std::size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+            area += static_cast<std::int64_t>(ring[j].x) * ring[i].y - static_cast<std::int64_t>(ring[i].x) * ring[j].y;
+        }
+        return area;
+    }
+
+    class command_encoder {
+    public:
+        std::vector<std::uint32_t> data;
+
+        void move_to(iline const &points) {
+            command(1, static_cast<std::uint32_t>(points.size()));
+            for (auto const &p: points) param(p);
+        }
+
+        // Line or ring; rings are closed with ClosePath instead of repeating the first point.
+        void path(iline const &points, bool close) {
+            command(1, 1);
+            param(points.front());
+            command(2, static_cast<std::uint32_t>(points.size() - 1));
+            for (std::size_t i = 1; i < points.size(); ++i) param(points[i]);
+            if (close) command(7, 1);
+        }
+
+    private:
+        void command(std::uint32_t id, std::uint32_t count) { data.push_back((id & 0x7) | (count << 3)); }
+
+        void param(ipoint const &p) {
+            data.push_back(zigzag(p.x - x_));
+            data.push_back(zigzag(p.y - y_));
+            x_ = p.x;
+            y_ = p.y;
+        }
+
+        static std::uint32_t zigzag(std::int32_t n) {
+            return (static_cast<std::uint32_t>(n) << 1) ^ static_cast<std::uint32_t>(n >> 31);
+        }
+
+        std::int32_t x_ = 0;
+        std::int32_t y_ = 0;
+    };
+
+    // Collects the parts of a (possibly mixed) geometry in tile coordinates.
+    struct tile_geometry {
+        std::vector<dpoint> points;
+        std::vector<dline> lines;
+        std::vector<std::vector<dline>> polygons;
+    };
+
+    class geometry_collector {
+    public:
+        geometry_collector(tile_geometry &out, mapnik::box2d<double> const &tile, mapnik::proj_transform const *transform)
+            : out_(out), tile_(tile), transform_(transform) {}
+
+        void operator()(mapnik::geometry::geometry_empty const &) const {}
+
+        void operator()(mapnik::geometry::point<double> const &pt) const { out_.points.push_back(project(pt)); }
+
+        void operator()(mapnik::geometry::line_string<double> const &line) const { out_.lines.push_back(project(line)); }
+
+        void operator()(mapnik::geometry::polygon<double> const &poly) const {
+            std::vector<dline> rings;
+            for (auto const &ring: poly) {
+                dline projected = project(ring);
+                if (projected.size() > 1 && projected.front().x == projected.back().x && projected.front().y == projected.back().y)
+                    projected.pop_back();
+                rings.push_back(std::move(projected));
+            }
+            out_.polygons.push_back(std::move(rings));
+        }
+
+        void operator()(mapnik::geometry::multi_point<double> const &points) const {
+            for (auto const &pt: points) (*this)(pt);
+        }
+
+        void operator()(mapnik::geometry::multi_line_string<double> const &lines) const {
+            for (auto const &line: lines) (*this)(line);
+        }
+
+        void operator()(mapnik::geometry::multi_polygon<double> const &polys) const {
+            for (auto const &poly: polys) (*this)(poly);
+        }
+
+        void operator()(mapnik::geometry::geometry_collection<double> const &collection) const {
+            for (auto const &geom: collection) mapnik::util::apply_visitor(*this, geom);
+        }
+
+    private:
+        dpoint project(mapnik::geometry::point<double> const &pt) const {
+            double x = pt.x, y = pt.y, z = 0.0;
+            if (transform_) transform_->forward(x, y, z);
+            return dpoint{(x - tile_.minx()) / tile_.width() * kExtent, (tile_.maxy() - y) / tile_.height() * kExtent};
+        }
+
+        template <typename Points>
+        dline project(Points const &points) const {
+            dline out;
+            out.reserve(points.size());
+            for (auto const &pt: points) out.push_back(project(pt));
+            return out;
+        }
+
+        tile_geometry &out_;
+        mapnik::box2d<double> tile_;
+        mapnik::proj_transform const *transform_;
+    };
+
+    struct value_encoder {
+        std::string operator()(mapnik::value_null const &) const { return std::string(); }
+
+        std::string operator()(mapnik::value_bool value) const {
+            std::string data;
+            protozero::pbf_writer(data).add_bool(value_bool, value);
+            return data;
+        }
+
+        std::string operator()(mapnik::value_integer value) const {
+            std::string data;
+            protozero::pbf_writer(data).add_sint64(value_sint, value);
+            return data;
+        }
+
+        std::string operator()(mapnik::value_double value) const {
+            std::string data;
+            protozero::pbf_writer(data).add_double(value_double, value);
+            return data;
+        }
+
+        std::string operator()(mapnik::value_unicode_string const &value) const {
+            std::string utf8;
+            mapnik::to_utf8(value, utf8);
+            std::string data;
+            protozero::pbf_writer(data).add_string(value_string, utf8);
+            return data;
+        }
+    };
+
+    class layer_encoder {
+    public:
+        explicit layer_encoder(std::string name) : name_(std::move(name)) {}
+
+        bool empty() const { return features_.empty(); }
+
+        void add(mapnik::feature_impl const &feature, tile_geometry const &geometry) {
+            std::vector<std::uint32_t> tags;
+            for (auto const &kv: feature) {
+                std::string value = mapnik::util::apply_visitor(value_encoder(), std::get<1>(kv));
+                if (value.empty()) continue;
+                tags.push_back(index_of(keys_, key_list_, std::get<0>(kv)));
+                tags.push_back(index_of(values_, value_list_, value));
+            }
+
+            double const lo = -kBuffer;
+            double const hi = kExtent + kBuffer;
+
+            iline points;
+            for (auto const &p: geometry.points) {
+                if (p.x >= lo && p.x <= hi && p.y >= lo && p.y <= hi) {
+                    points.push_back(ipoint{static_cast<std::int32_t>(std::lround(p.x)), static_cast<std::int32_t>(std::lround(p.y))});
+                }
+            }
+            if (!points.empty()) {
+                command_encoder enc;
+                enc.move_to(points);
+                write(feature.id(), tags, geom_point, enc.data);
+            }
+
+            command_encoder lines;
+            for (auto const &line: geometry.lines) {
+                for (auto const &part: clip_line(line, lo, hi)) {
+                    iline q = quantise(part);
+                    if (q.size() > 1) lines.path(q, false);
+                }
+            }
+            if (!lines.data.empty()) write(feature.id(), tags, geom_linestring, lines.data);
+
+            command_encoder polygons;
+            for (auto const &poly: geometry.polygons) {
+                bool exterior = true;
+                bool keep_holes = false;
+                for (auto const &ring: poly) {
+                    iline q = quantise(clip_ring(ring, lo, hi));
+                    if (q.size() > 1 && q.front().x == q.back().x && q.front().y == q.back().y) q.pop_back();
+                    std::int64_t const area = q.size() > 2 ? ring_area(q) : 0;
+                    if (area == 0) {
+                        // A degenerate exterior ring takes its holes with it.
+                        if (exterior) keep_holes = false;
+                        exterior = false;
+                        continue;
+                    }
+                    if (!exterior && !keep_holes) continue;
+                    // Exterior rings have positive, interior rings negative area (y axis down).
+                    if ((exterior && area < 0) || (!exterior && area > 0)) std::reverse(q.begin(), q.end());
+                    polygons.path(q, true);
+                    if (exterior) keep_holes = true;
+                    exterior = false;
+                }
+            }
+            if (!polygons.data.empty()) write(feature.id(), tags, geom_polygon, polygons.data);
+        }
+
+        void write(protozero::pbf_writer &tile) const {
+            protozero::pbf_writer layer(tile, tile_layers);
+            layer.add_uint32(layer_version, 2);
+            layer.add_string(layer_name, name_);
+            for (auto const &feature: features_) layer.add_message(layer_features, feature);
+            for (auto const &key: key_list_) layer.add_string(layer_keys, key);
+            for (auto const &value: value_list_) layer.add_message(layer_values, value);
+            layer.add_uint32(layer_extent, kExtent);
+        }
+
+    private:
+        static std::uint32_t index_of(std::unordered_map<std::string, std::uint32_t> &index,
+                                      std::vector<std::string> &list, std::string const &item) {
+            auto it = index.find(item);
+            if (it != index.end()) return it->second;
+            auto const id = static_cast<std::uint32_t>(list.size());
+            index.emplace(item, id);
+            list.push_back(item);
+            return id;
+        }
+
+        void write(mapnik::value_integer id, std::vector<std::uint32_t> const &tags, geom_type type,
+                   std::vector<std::uint32_t> const &commands) {
+            std::string data;
+            protozero::pbf_writer feature(data);
+            if (id >= 0) feature.add_uint64(feature_id, static_cast<std::uint64_t>(id));
+            if (!tags.empty()) feature.add_packed_uint32(feature_tags, tags.begin(), tags.end());
+            feature.add_enum(feature_type, static_cast<std::int32_t>(type));
+            feature.add_packed_uint32(feature_geometry, commands.begin(), commands.end());
+            features_.push_back(std::move(data));
+        }
+
+        std::string name_;
+        std::vector<std::string> features_;
+        std::unordered_map<std::string, std::uint32_t> keys_;
+        std::vector<std::string> key_list_;
+        std::unordered_map<std::string, std::uint32_t> values_;
+        std::vector<std::string> value_list_;
+    };
+}
+
+extern "C" {
+    // Encodes the named layers (comma separated, in map order; all active layers if empty)
+    // for tile z/x/y. Layers are queried in their own SRS and projected to web mercator.
+    // Returns the tile bytes (free with mem_free); nullptr on error.
+    EXPORT void *map_render_mvt(void *map_ptr, int32_t z, int32_t x, int32_t y, const char *layers, uint64_t *out_len) {
+        if (!out_len) {
+            _set_last_error("map_render_mvt: out_len is null");
+            return nullptr;
+        }
+        *out_len = 0;
+        if (!map_ptr) {
+            _set_last_error("map_render_mvt: null map");
+            return nullptr;
+        }
+        if (z < 0 || z > 30 || x < 0 || y < 0 || x >= (1 << z) || y >= (1 << z)) {
+            _set_last_error("map_render_mvt: invalid tile coordinates");
+            return nullptr;
+        }
+
+        try {
+            auto *map = static_cast<mapnik::Map *>(map_ptr);
+            std::unordered_set<std::string> selected;
+            if (layers) {
+                std::istringstream in(layers);
+                std::string name;
+                while (std::getline(in, name, ',')) {
+                    if (!name.empty()) selected.insert(name);
+                }
+            }
+
+            double const size = 2.0 * kMercatorHalf / static_cast<double>(1u << z);
+            mapnik::box2d<double> const tile(-kMercatorHalf + x * size, kMercatorHalf - (y + 1) * size,
+                                             -kMercatorHalf + (x + 1) * size, kMercatorHalf - y * size);
+            double const pad = size * kBuffer / kExtent;
+            mapnik::box2d<double> const buffered(tile.minx() - pad, tile.miny() - pad, tile.maxx() + pad, tile.maxy() + pad);
+            double const resolution = kTileSize / size;
+            double const scale_denominator = size / kTileSize / 0.00028;
+
+            std::string data;
+            protozero::pbf_writer out(data);
+            for (auto const &lyr: map->layers()) {
+                if (!selected.empty() && selected.find(lyr.name()) == selected.end()) continue;
+                if (!lyr.active() || !lyr.visible(scale_denominator)) continue;
+                mapnik::datasource_ptr ds = lyr.datasource();
+                if (!ds) continue;
+
+                auto entry = wrapper::cached_transform_for(lyr.srs(), kMercatorSrs);
+                mapnik::proj_transform const *transform = entry->identity ? nullptr : &wrapper::thread_transform(entry);
+                mapnik::box2d<double> query_box = buffered;
+                if (transform && !transform->backward(query_box)) continue;
+
+                mapnik::query q(query_box, mapnik::query::resolution_type(resolution, resolution), scale_denominator, query_box);
+                for (auto const &attribute: ds->get_descriptor().get_descriptors()) {
+                    q.add_property_name(attribute.get_name());
+                }
+
+                layer_encoder encoder(lyr.name());
+                mapnik::featureset_ptr fs = ds->features(q);
+                if (fs) {
+                    while (mapnik::feature_ptr feature = fs->next()) {
+                        tile_geometry geometry;
+                        geometry_collector collector(geometry, tile, transform);
+                        mapnik::util::apply_visitor(collector, feature->get_geometry());
+                        encoder.add(*feature, geometry);
+                    }
+                }
+                if (!encoder.empty()) encoder.write(out);
+            }
+
+            // An empty tile is a valid result: non-null buffer with length 0.
+            void *buf = std::malloc(std::max<std::size_t>(data.size(), 1));
+            if (!buf) {
+                _set_last_error("map_render_mvt: malloc failed");
+                return nullptr;
+            }
+            if (!data.empty()) std::memcpy(buf, data.data(), data.size());
+            *out_len = static_cast<uint64_t>(data.size());
+            return buf;
+        } catch (std::exception const &ex) {
+            _set_last_error(ex.what());
+            return nullptr;
+        } catch (...) {
+            _set_last_error("map_render_mvt: unknown error");
+            return nullptr;
+        }
+    }
+}
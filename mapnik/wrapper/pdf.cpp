@@ -0,0 +1,239 @@
+/*
+ * Copyright 2019-2025 Simon Zigelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "include/mapnik.h"
+#include "mapnik_internal.h"
+
+#include <mapnik/map.hpp>
+
+#if defined(MAPNIK_USE_CAIRO)
+#include <mapnik/cairo/cairo_renderer.hpp>
+#include <mapnik/cairo/cairo_context.hpp>
+#include <cairo.h>
+#include <cairo-pdf.h>
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// -----------------------------
+// PDF document helpers
+// Several maps are rendered as vectors onto the pages of one Cairo PDF document.
+// Coordinates and sizes are in PDF points (1/72 inch), origin top left.
+// handle type: pdf_document* (allocated with new)
+// -----------------------------
+
+#if defined(MAPNIK_USE_CAIRO)
+namespace {
+    struct pdf_document {
+        std::string data;
+        mapnik::cairo_surface_ptr surface;
+        mapnik::cairo_ptr context;
+        bool page_used = false;
+    };
+
+    cairo_status_t pdf_write(void *closure, unsigned char const *data, unsigned int length) {
+        static_cast<std::string *>(closure)->append(reinterpret_cast<char const *>(data), length);
+        return CAIRO_STATUS_SUCCESS;
+    }
+
+    bool pdf_ok(pdf_document *doc, char const *context) {
+        cairo_status_t status = cairo_status(doc->context.get());
+        if (status != CAIRO_STATUS_SUCCESS) {
+            _set_last_error((std::string(context) + ": " + cairo_status_to_string(status)).c_str());
+            return false;
+        }
+        return true;
+    }
+}
+#endif
+
+extern "C" {
+
+EXPORT void *pdf_document_new(double width_pt, double height_pt) {
+#if !defined(MAPNIK_USE_CAIRO)
+    _set_last_error("pdf_document_new: Mapnik built without Cairo (MAPNIK_USE_CAIRO not defined)");
+    return nullptr;
+#else
+    if (width_pt <= 0 || height_pt <= 0) {
+        _set_last_error("pdf_document_new: invalid page size");
+        return nullptr;
+    }
+    try {
+        auto *doc = new pdf_document();
+        doc->surface = mapnik::cairo_surface_ptr(
+            cairo_pdf_surface_create_for_stream(pdf_write, &doc->data, width_pt, height_pt),
+            mapnik::cairo_surface_closer());
+        doc->context = mapnik::create_context(doc->surface);
+        if (!pdf_ok(doc, "pdf_document_new")) {
+            delete doc;
+            return nullptr;
+        }
+        return doc;
+    } catch (std::exception const &ex) {
+        _set_last_error(ex.what());
+        return nullptr;
+    } catch (...) {
+        _set_last_error("pdf_document_new: unknown error");
+        return nullptr;
+    }
+#endif
+}
+
+EXPORT void pdf_document_free(void *doc_ptr) {
+#if defined(MAPNIK_USE_CAIRO)
+    if (doc_ptr) {
+        delete static_cast<pdf_document *>(doc_ptr);
+    }
+#endif
+}
+
+// Starts a new page; the first call only sets the size of the initial page.
+EXPORT int32_t pdf_document_begin_page(void *doc_ptr, double width_pt, double height_pt) {
+#if !defined(MAPNIK_USE_CAIRO)
+    _set_last_error("pdf_document_begin_page: Mapnik built without Cairo (MAPNIK_USE_CAIRO not defined)");
+    return 0;
+#else
+    if (!doc_ptr || width_pt <= 0 || height_pt <= 0) {
+        _set_last_error("pdf_document_begin_page: null document or invalid page size");
+        return 0;
+    }
+    auto *doc = static_cast<pdf_document *>(doc_ptr);
+    if (doc->page_used) {
+        cairo_show_page(doc->context.get());
+    }
+    cairo_pdf_surface_set_size(doc->surface.get(), width_pt, height_pt);
+    doc->page_used = true;
+    return pdf_ok(doc, "pdf_document_begin_page") ? 1 : 0;
+#endif
+}
+
+// Renders the map as vectors into the box (x, y, width, height), scaled uniformly to fit
+// and centered. scale_factor is passed to the renderer (line widths, text sizes).
+EXPORT int32_t pdf_document_place_map(void *doc_ptr, void *map_ptr, double x, double y,
+                                      double width_pt, double height_pt, double scale_factor) {
+#if !defined(MAPNIK_USE_CAIRO)
+    _set_last_error("pdf_document_place_map: Mapnik built without Cairo (MAPNIK_USE_CAIRO not defined)");
+    return 0;
+#else
+    if (!doc_ptr || !map_ptr) {
+        _set_last_error("pdf_document_place_map: null document or map");
+        return 0;
+    }
+    try {
+        auto *doc = static_cast<pdf_document *>(doc_ptr);
+        auto *map = static_cast<mapnik::Map *>(map_ptr);
+        if (map->width() == 0 || map->height() == 0 || width_pt <= 0 || height_pt <= 0) {
+            _set_last_error("pdf_document_place_map: empty map or box");
+            return 0;
+        }
+        double const mw = static_cast<double>(map->width());
+        double const mh = static_cast<double>(map->height());
+        double const s = std::min(width_pt / mw, height_pt / mh);
+
+        cairo_t *cr = doc->context.get();
+        cairo_save(cr);
+        cairo_translate(cr, x + (width_pt - mw * s) / 2.0, y + (height_pt - mh * s) / 2.0);
+        cairo_scale(cr, s, s);
+        cairo_rectangle(cr, 0, 0, mw, mh);
+        cairo_clip(cr);
+        mapnik::cairo_renderer<mapnik::cairo_ptr> ren(*map, doc->context, scale_factor > 0 ? scale_factor : 1.0);
+        ren.apply();
+        cairo_restore(cr);
+        doc->page_used = true;
+        return pdf_ok(doc, "pdf_document_place_map") ? 1 : 0;
+    } catch (std::exception const &ex) {
+        _set_last_error(ex.what());
+        return 0;
+    } catch (...) {
+        _set_last_error("pdf_document_place_map: unknown error");
+        return 0;
+    }
+#endif
+}
+
+// Draws a single line of text with its baseline at (x, y).
+EXPORT int32_t pdf_document_add_text(void *doc_ptr, const char *text, double x, double y, double size_pt) {
+#if !defined(MAPNIK_USE_CAIRO)
+    _set_last_error("pdf_document_add_text: Mapnik built without Cairo (MAPNIK_USE_CAIRO not defined)");
+    return 0;
+#else
+    if (!doc_ptr || !text) {
+        _set_last_error("pdf_document_add_text: null document or text");
+        return 0;
+    }
+    auto *doc = static_cast<pdf_document *>(doc_ptr);
+    cairo_t *cr = doc->context.get();
+    cairo_save(cr);
+    cairo_select_font_face(cr, "sans-serif", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, size_pt);
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_move_to(cr, x, y);
+    cairo_show_text(cr, text);
+    cairo_restore(cr);
+    doc->page_used = true;
+    return pdf_ok(doc, "pdf_document_add_text") ? 1 : 0;
+#endif
+}
+
+// Finishes the document and returns its bytes (free with mem_free). The document
+// cannot be drawn to afterwards.
+EXPORT void *pdf_document_finish(void *doc_ptr, uint64_t *out_len) {
+    if (!out_len) {
+        _set_last_error("pdf_document_finish: out_len is null");
+        return nullptr;
+    }
+    *out_len = 0;
+
+#if !defined(MAPNIK_USE_CAIRO)
+    _set_last_error("pdf_document_finish: Mapnik built without Cairo (MAPNIK_USE_CAIRO not defined)");
+    return nullptr;
+#else
+    if (!doc_ptr) {
+        _set_last_error("pdf_document_finish: null document");
+        return nullptr;
+    }
+    try {
+        auto *doc = static_cast<pdf_document *>(doc_ptr);
+        cairo_surface_finish(doc->surface.get());
+        cairo_status_t status = cairo_surface_status(doc->surface.get());
+        if (status != CAIRO_STATUS_SUCCESS) {
+            _set_last_error((std::string("pdf_document_finish: ") + cairo_status_to_string(status)).c_str());
+            return nullptr;
+        }
+
+        void *buf = std::malloc(doc->data.size());
+        if (!buf && !doc->data.empty()) {
+            _set_last_error("pdf_document_finish: malloc failed");
+            return nullptr;
+        }
+        if (!doc->data.empty()) std::memcpy(buf, doc->data.data(), doc->data.size());
+        *out_len = static_cast<uint64_t>(doc->data.size());
+        std::string().swap(doc->data);
+        return buf;
+    } catch (std::exception const &ex) {
+        _set_last_error(ex.what());
+        return nullptr;
+    } catch (...) {
+        _set_last_error("pdf_document_finish: unknown error");
+        return nullptr;
+    }
+#endif
+}
+
+}
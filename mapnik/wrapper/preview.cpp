@@ -0,0 +1,151 @@
+/*
+ * Copyright 2019-2025 Simon Zigelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "include/mapnik.h"
+#include "mapnik_internal.h"
+
+#include <mapnik/map.hpp>
+#include <mapnik/layer.hpp>
+#include <mapnik/feature_type_style.hpp>
+#include <mapnik/rule.hpp>
+#include <mapnik/symbolizer.hpp>
+#include <mapnik/symbolizer_keys.hpp>
+#include <mapnik/util/variant.hpp>
+
+#include <algorithm>
+#include <set>
+#include <sstream>
+#include <string>
+
+// -----------------------------
+// Preview profile
+// Reduces a loaded map (e.g. osm.xml) in place to a cheap preview: labels and
+// 3D buildings are removed, geometries are simplified, image filters are
+// dropped and layers left without anything to draw are not queried at all.
+// -----------------------------
+
+namespace {
+    bool expensive_only(mapnik::symbolizer const &sym) {
+        return sym.is<mapnik::text_symbolizer>() || sym.is<mapnik::shield_symbolizer>() ||
+               sym.is<mapnik::building_symbolizer>();
+    }
+
+    struct coarsen {
+        double tolerance;
+
+        void operator()(mapnik::line_symbolizer &sym) const { simplify(sym); }
+
+        void operator()(mapnik::polygon_symbolizer &sym) const { simplify(sym); }
+
+        template <typename Symbolizer>
+        void operator()(Symbolizer &sym) const {
+            sym.properties.erase(mapnik::keys::smooth);
+        }
+
+    private:
+        template <typename Symbolizer>
+        void simplify(Symbolizer &sym) const {
+            if (tolerance > 0.0) mapnik::put(sym, mapnik::keys::simplify_tolerance, mapnik::value_double(tolerance));
+            sym.properties.erase(mapnik::keys::smooth);
+        }
+    };
+
+    // Removes rules left without symbolizers. An empty rule whose filter matches still keeps
+    // the style's else-rules from applying, so those are only removed if no else-rule remains.
+    // With filter-mode="first" it also keeps the features from every later rule, so there
+    // only the empty rules after the last one that draws anything are removed.
+    void remove_empty_rules(mapnik::feature_type_style &style) {
+        auto &rules = style.get_rules_nonconst();
+        auto const empty = [](mapnik::rule const &r) { return r.get_symbolizers().empty(); };
+        rules.erase(std::remove_if(rules.begin(), rules.end(), [&](mapnik::rule const &r) {
+            return empty(r) && (r.has_else_filter() || r.has_also_filter());
+        }), rules.end());
+        bool const has_else = std::any_of(rules.begin(), rules.end(), [](mapnik::rule const &r) { return r.has_else_filter(); });
+        if (has_else) return;
+        if (style.get_filter_mode() == mapnik::FILTER_FIRST) {
+            auto const last = std::find_if(rules.rbegin(), rules.rend(), [&](mapnik::rule const &r) { return !empty(r); });
+            rules.erase(last.base(), rules.end());
+        } else {
+            rules.erase(std::remove_if(rules.begin(), rules.end(), empty), rules.end());
+        }
+    }
+
+    bool has_symbolizers(mapnik::feature_type_style const &style) {
+        for (auto const &r: style.get_rules()) {
+            if (!r.get_symbolizers().empty()) return true;
+        }
+        return false;
+    }
+}
+
+extern "C" {
+    // simplify_tolerance is in pixels; drop_layers lists additional layer names (newline
+    // separated) to remove. Only call on a map of its own, the full style is modified.
+    // Returns the number of removed layers or -1 on error.
+    EXPORT int32_t map_derive_preview(void *map_ptr, double simplify_tolerance, const char *drop_layers) {
+        if (!map_ptr) {
+            _set_last_error("map_derive_preview: null map");
+            return -1;
+        }
+        try {
+            auto *map = static_cast<mapnik::Map *>(map_ptr);
+            std::set<std::string> dropped;
+            if (drop_layers) {
+                std::istringstream in(drop_layers);
+                std::string name;
+                while (std::getline(in, name)) {
+                    if (!name.empty()) dropped.insert(name);
+                }
+            }
+
+            std::set<std::string> empty_styles;
+            for (auto &entry: map->styles()) {
+                mapnik::feature_type_style &style = entry.second;
+                style.image_filters().clear();
+                style.direct_image_filters().clear();
+                for (auto &r: style.get_rules_nonconst()) {
+                    for (std::size_t i = r.get_symbolizers().size(); i-- > 0;) {
+                        if (expensive_only(r.get_symbolizers()[i])) r.remove_at(i);
+                    }
+                    for (auto it = r.begin(); it != r.end(); ++it) {
+                        mapnik::util::apply_visitor(coarsen{simplify_tolerance}, *it);
+                    }
+                }
+                remove_empty_rules(style);
+                if (!has_symbolizers(style)) empty_styles.insert(entry.first);
+            }
+
+            auto &layers = map->layers();
+            for (auto &lyr: layers) {
+                auto &styles = lyr.styles();
+                styles.erase(std::remove_if(styles.begin(), styles.end(),
+                                            [&](std::string const &name) { return empty_styles.count(name) > 0; }),
+                             styles.end());
+            }
+            std::size_t const before = layers.size();
+            layers.erase(std::remove_if(layers.begin(), layers.end(), [&](mapnik::layer const &lyr) {
+                return lyr.styles().empty() || dropped.count(lyr.name()) > 0;
+            }), layers.end());
+            return static_cast<int32_t>(before - layers.size());
+        } catch (std::exception const &ex) {
+            _set_last_error(ex.what());
+            return -1;
+        } catch (...) {
+            _set_last_error("map_derive_preview: unknown error");
+            return -1;
+        }
+    }
+}
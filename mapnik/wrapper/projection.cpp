@@ -0,0 +1,178 @@
+/*
+ * Copyright 2019-2025 Simon Zigelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "include/mapnik.h"
+#include "mapnik_internal.h"
+#include "projection_internal.h"
+
+#include <mapnik/datasource.hpp>
+#include <mapnik/feature.hpp>
+#include <mapnik/featureset.hpp>
+#include <mapnik/geometry/reprojection.hpp>
+#include <mapnik/memory_datasource.hpp>
+#include <mapnik/params.hpp>
+#include <mapnik/query.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// -----------------------------
+// Projection cache
+// Process-wide PROJ transforms keyed by source/target SRS. PROJ objects are not
+// safe for concurrent use, so each entry carries its own mutex.
+// -----------------------------
+
+namespace {
+    bool maps_onto_itself(mapnik::proj_transform const &transform) {
+        double const samples[][2] = {{0.0, 0.0}, {1.0e6, 5.0e6}, {-1.5e7, -8.0e6}, {12.5, 47.5}};
+        for (auto const &sample: samples) {
+            double x = sample[0], y = sample[1], z = 0.0;
+            if (!transform.forward(x, y, z)) return false;
+            if (std::abs(x - sample[0]) > 1e-6 || std::abs(y - sample[1]) > 1e-6) return false;
+        }
+        return true;
+    }
+
+    class transform_cache {
+    public:
+        static transform_cache &instance() {
+            static transform_cache cache;
+            return cache;
+        }
+
+        std::shared_ptr<wrapper::cached_transform> get(std::string const &src, std::string const &dst) {
+            std::string const key = src + '\x1f' + dst;
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = entries_.find(key);
+            if (it != entries_.end()) {
+                ++hits_;
+                return it->second;
+            }
+            ++misses_;
+            auto entry = std::make_shared<wrapper::cached_transform>(src, dst);
+            entries_.emplace(key, entry);
+            return entry;
+        }
+
+        std::string stats_json() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::size_t identity = 0;
+            for (auto const &entry: entries_) {
+                if (entry.second->identity) ++identity;
+            }
+            return "{\"entries\":" + std::to_string(entries_.size()) +
+                   ",\"identity\":" + std::to_string(identity) +
+                   ",\"hits\":" + std::to_string(hits_) +
+                   ",\"misses\":" + std::to_string(misses_) + "}";
+        }
+
+    private:
+        std::mutex mutex_;
+        std::unordered_map<std::string, std::shared_ptr<wrapper::cached_transform>> entries_;
+        std::uint64_t hits_ = 0;
+        std::uint64_t misses_ = 0;
+    };
+}
+
+namespace wrapper {
+    cached_transform::cached_transform(std::string const &src, std::string const &dst)
+        : source(src), target(dst), transform(source, target) {
+        identity = transform.equal() || maps_onto_itself(transform);
+    }
+
+    std::shared_ptr<cached_transform> cached_transform_for(std::string const &src, std::string const &dst) {
+        return transform_cache::instance().get(src, dst);
+    }
+
+    mapnik::proj_transform const &thread_transform(std::shared_ptr<cached_transform> const &entry) {
+        // Entries are never evicted, so their address identifies them for the thread's lifetime.
+        static thread_local std::unordered_map<cached_transform const *, std::unique_ptr<mapnik::proj_transform>> copies;
+        auto &copy = copies[entry.get()];
+        if (!copy) {
+            std::lock_guard<std::mutex> lock(entry->mutex);
+            copy = std::make_unique<mapnik::proj_transform>(entry->source, entry->target);
+        }
+        return *copy;
+    }
+}
+
+extern "C" {
+    static thread_local std::string g_proj_cache_buffer;
+
+    EXPORT const char *proj_cache_stats() {
+        try {
+            g_proj_cache_buffer = transform_cache::instance().stats_json();
+            return g_proj_cache_buffer.c_str();
+        } catch (...) {
+            return "{}";
+        }
+    }
+
+    // Returns a datasource whose features are projected from source_srs into target_srs
+    // once, so a layer in target_srs renders on the identity path. For equivalent SRS the
+    // input datasource is shared as is. handle type: mapnik::datasource_ptr*
+    EXPORT void *datasource_projected_new(void *ds_ptr, const char *source_srs, const char *target_srs) {
+        if (!ds_ptr || !source_srs || !target_srs) {
+            _set_last_error("datasource_projected_new: null datasource or srs");
+            return nullptr;
+        }
+        try {
+            auto const &ds = *static_cast<mapnik::datasource_ptr *>(ds_ptr);
+            if (!ds) {
+                _set_last_error("datasource_projected_new: invalid datasource");
+                return nullptr;
+            }
+            auto entry = wrapper::cached_transform_for(source_srs, target_srs);
+            if (entry->identity) {
+                return new mapnik::datasource_ptr(ds);
+            }
+
+            mapnik::parameters params;
+            params["type"] = std::string("memory");
+            auto projected = std::make_shared<mapnik::memory_datasource>(params);
+
+            mapnik::query q(ds->envelope());
+            for (auto const &attribute: ds->get_descriptor().get_descriptors()) {
+                q.add_property_name(attribute.get_name());
+            }
+            mapnik::featureset_ptr fs = ds->features(q);
+            if (fs) {
+                std::lock_guard<std::mutex> lock(entry->mutex);
+                while (mapnik::feature_ptr feature = fs->next()) {
+                    unsigned int errors = 0;
+                    auto geometry = mapnik::geometry::reproject_copy(feature->get_geometry(), entry->transform, errors);
+                    if (errors > 0) continue;
+                    // The source may hand out its own (shared) features; project a copy.
+                    auto copy = std::make_shared<mapnik::feature_impl>(feature->context(), feature->id());
+                    copy->set_data(feature->get_data());
+                    copy->set_geometry(std::move(geometry));
+                    projected->push(copy);
+                }
+            }
+            return new mapnik::datasource_ptr(projected);
+        } catch (std::exception const &ex) {
+            _set_last_error(ex.what());
+            return nullptr;
+        } catch (...) {
+            _set_last_error("datasource_projected_new: unknown error");
+            return nullptr;
+        }
+    }
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2019-2025 Simon Zigelli
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <mapnik/projection.hpp>
+#include <mapnik/proj_transform.hpp>
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+// -----------------------------
+// Shared projection helpers (C++ only, not exported)
+// -----------------------------
+
+namespace wrapper {
+    // A PROJ transform from the process-wide cache. PROJ objects are not safe for
+    // concurrent use, so lock `mutex` while transforming.
+    struct cached_transform {
+        mapnik::projection source;
+        mapnik::projection target;
+        mapnik::proj_transform transform;
+        // Both definitions describe the same CRS (e.g. two spellings of web mercator).
+        bool identity = false;
+        std::mutex mutex;
+
+        cached_transform(std::string const &src, std::string const &dst);
+    };
+
+    std::shared_ptr<cached_transform> cached_transform_for(std::string const &src, std::string const &dst);
+
+    // A copy of entry's transform owned by the calling thread, for loops that would otherwise
+    // hold entry's mutex for their whole duration. Built once per thread and entry.
+    mapnik::proj_transform const &thread_transform(std::shared_ptr<cached_transform> const &entry);
+}